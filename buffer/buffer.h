@@ -1,6 +1,7 @@
 #ifndef _BUFFER_H
 #define _BUFFER_H
 
+#include <string>
 #include <vector>
 #include <memory>
 #include <string.h>
@@ -1,6 +1,7 @@
 #include <assert.h>
 #include <fcntl.h>
 #include <dlfcn.h>
+#include <errno.h>
 #include <string.h>
 #include <unistd.h>
 
@@ -31,6 +32,17 @@ void toEpoll(FdEvent::ptr fd_event, IOEvent events) {
     fd_event->addListenEvents(events);
 }
 
+/* fd 已经常驻注册在 epoll 中, 只需要记录等待的协程和事件, 由 reactor 在就绪时 resume */
+void waitPersistent(FdEvent::ptr fd_event, IOEvent events) {
+    fd_event->setCoroutine(Coroutine::GetCurrentCoroutine());
+    fd_event->setWaitEvents(events);
+
+    Coroutine::Yield();
+
+    fd_event->setWaitEvents(0);
+    fd_event->clearCoroutine();
+}
+
 int accept_hook(int sockfd, struct sockaddr *addr, socklen_t *addrlen) {
     LOG_DEBUG << "this is hook accept";
     if(Coroutine::IsMainCoroutine()) {
@@ -62,7 +74,7 @@ int connect_hook(int sockfd, const struct sockaddr *addr, socklen_t addrlen) {
     LOG_DEBUG << "this is hook connect";
     if(Coroutine::IsMainCoroutine()) {
         LOG_DEBUG << "hook disable, call sys connect func";
-        g_sys_connect_fun(sockfd, addr, addrlen);
+        return g_sys_connect_fun(sockfd, addr, addrlen);
     }
 
     FdEvent::ptr fd_event = FdEventContainer::GetFdContainer()->getFdEvent(sockfd);
@@ -89,9 +101,8 @@ int connect_hook(int sockfd, const struct sockaddr *addr, socklen_t addrlen) {
         Coroutine::Resume(cor);
     };
 
-    TimerEvent::ptr tevent = std::make_shared<TimerEvent>(max_connect_timeout, false, timeout_cb);
     Timer *timer = reactor->getTimer();
-    timer->addTimerEvent(tevent);
+    TimerHandle timeout_handle = timer->addTimer(max_connect_timeout, timeout_cb);
 
     LOG_DEBUG << "connect func to yield";
     Coroutine::Yield();
@@ -99,7 +110,7 @@ int connect_hook(int sockfd, const struct sockaddr *addr, socklen_t addrlen) {
 
     fd_event->delListenEvents(IOEvent::WRITE);
     fd_event->clearCoroutine();
-    timer->delTimerEvent(tevent);
+    timer->cancelTimer(timeout_handle);
 
     n = g_sys_connect_fun(sockfd, addr, addrlen);
     if ((n < 0 && errno == EISCONN) || n == 0) {
@@ -124,6 +135,19 @@ ssize_t read_hook(int fd, void *buf, size_t count) {
     }
 
     FdEvent::ptr fd_event = FdEventContainer::GetFdContainer()->getFdEvent(fd);
+    if(fd_event->isPersistent()) {
+        /* 后端可能给出多余的就绪通知 (比如 io_uring multishot 重新挂上时), 仍然 EAGAIN 就继续等 */
+        while(true) {
+            int n = g_sys_read_fun(fd, buf, count);
+            if(n >= 0 || errno != EAGAIN) {
+                return n;
+            }
+
+            LOG_DEBUG << "read func to wait persistent event";
+            waitPersistent(fd_event, IOEvent::READ);
+        }
+    }
+
     fd_event->setReactor(Reactor::GetReactor());
     fd_event->setNonBlock();
     
@@ -152,6 +176,19 @@ ssize_t write_hook(int fd, const void *buf, size_t count) {
     }
 
     FdEvent::ptr fd_event = FdEventContainer::GetFdContainer()->getFdEvent(fd);
+    if(fd_event->isPersistent()) {
+        /* 后端可能给出多余的就绪通知 (比如 io_uring multishot 重新挂上时), 仍然 EAGAIN 就继续等 */
+        while(true) {
+            int n = g_sys_write_fun(fd, buf, count);
+            if(n >= 0 || errno != EAGAIN) {
+                return n;
+            }
+
+            LOG_DEBUG << "write func to wait persistent event";
+            waitPersistent(fd_event, IOEvent::WRITE);
+        }
+    }
+
     fd_event->setReactor(Reactor::GetReactor());
     fd_event->setNonBlock();
 
@@ -185,8 +222,7 @@ unsigned int sleep_hook(unsigned int seconds) {
         Coroutine::Resume(cor);
     };
 
-    TimerEvent::ptr event = std::make_shared<TimerEvent>(1000 * seconds, false, timeout_cb);
-    Reactor::GetReactor()->getTimer()->addTimerEvent(event);
+    Reactor::GetReactor()->getTimer()->addTimer(1000 * seconds, timeout_cb);
 
     LOG_DEBUG << "now to yield sleep";
     while(!is_timeout) {
@@ -1,6 +1,7 @@
 #include "memory.h"
 
 #include <assert.h>
+#include <stdlib.h>
 
 namespace util {
 
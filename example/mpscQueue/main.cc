@@ -0,0 +1,117 @@
+#include "mutex.h"
+#include "mpscQueue.h"
+
+#include <time.h>
+#include <atomic>
+#include <vector>
+#include <thread>
+#include <iostream>
+#include <functional>
+
+using namespace std;
+using namespace util;
+
+/* 对比 Reactor 旧的 Mutex + vector swap 任务队列 和 新的无锁 MpscQueue */
+
+const int PER_PRODUCER = 200000;
+
+struct TaskNode : public MpscNode {
+    std::function<void()> m_task;
+};
+
+static int64_t nowNs() {
+    timespec ts;
+    ::clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/* 旧实现: 生产者加锁 push_back, 消费者加锁 swap 后执行 */
+double benchMutexQueue(int producers) {
+    Mutex mutex;
+    std::vector<std::function<void()>> pending;
+    std::atomic_bool start(false);
+    int64_t total = (int64_t)producers * PER_PRODUCER;
+    int64_t done = 0;
+
+    std::vector<std::thread> threads;
+    for(int i = 0; i < producers; i++) {
+        threads.emplace_back([&]() {
+            while(!start) {}
+            for(int j = 0; j < PER_PRODUCER; j++) {
+                Mutex::Lock lock(mutex);
+                pending.push_back([&done]() { done++; });
+            }
+        });
+    }
+
+    int64_t begin = nowNs();
+    start = true;
+    std::vector<std::function<void()>> tmp;
+    while(done < total) {
+        Mutex::Lock lock(mutex);
+        tmp.swap(pending);
+        lock.unlock();
+
+        for(size_t i = 0; i < tmp.size(); i++) {
+            tmp[i]();
+        }
+        tmp.clear();
+    }
+    int64_t end = nowNs();
+
+    for(auto &t : threads) {
+        t.join();
+    }
+    return (double)(end - begin) / total;
+}
+
+/* 新实现: 生产者无锁入队, 消费者无锁出队 */
+double benchMpscQueue(int producers) {
+    MpscQueue<TaskNode> pending;
+    std::atomic_bool start(false);
+    int64_t total = (int64_t)producers * PER_PRODUCER;
+    int64_t done = 0;
+
+    std::vector<std::thread> threads;
+    for(int i = 0; i < producers; i++) {
+        threads.emplace_back([&]() {
+            while(!start) {}
+            for(int j = 0; j < PER_PRODUCER; j++) {
+                TaskNode *node = new TaskNode();
+                node->m_task = [&done]() { done++; };
+                pending.push(node);
+            }
+        });
+    }
+
+    int64_t begin = nowNs();
+    start = true;
+    while(done < total) {
+        TaskNode *node = nullptr;
+        while((node = pending.pop()) != nullptr) {
+            node->m_task();
+            delete node;
+        }
+    }
+    int64_t end = nowNs();
+
+    for(auto &t : threads) {
+        t.join();
+    }
+    return (double)(end - begin) / total;
+}
+
+int main() {
+    cout << "hardware threads = " << std::thread::hardware_concurrency()
+         << ", tasks per producer = " << PER_PRODUCER << endl;
+    cout << "producers\tmutex(ns/task)\tmpsc(ns/task)" << endl;
+
+    int counts[] = {1, 2, 4, 8, 16};
+    for(int producers : counts) {
+        double old_ns = benchMutexQueue(producers);
+        double new_ns = benchMpscQueue(producers);
+        cout << producers << "\t\t" << old_ns << "\t\t" << new_ns << endl;
+    }
+
+    return 0;
+}
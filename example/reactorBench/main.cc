@@ -0,0 +1,173 @@
+#include "reactor.h"
+#include "tcpServer.h"
+
+#include <time.h>
+#include <string.h>
+#include <unistd.h>
+#include <thread>
+#include <vector>
+#include <atomic>
+#include <iostream>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+using namespace std;
+using namespace util;
+
+/*
+ * 对比 epoll 和 io_uring 两种 Reactor 后端
+ * 每个后端在单独的子进程中启动一个 TCP echo 服务, 多个客户端线程在长连接上做 ping-pong
+ * 输出每秒请求数, 以及服务端 Reactor 平均每个请求发起的后端系统调用次数
+ */
+
+const int CLIENTS = 16;
+const int REQUESTS_PER_CLIENT = 2000;
+const int MSG_SIZE = 64;
+
+static int64_t nowNs() {
+    timespec ts;
+    ::clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static int connectTo(uint16_t port) {
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+    addr.sin_port = htons(port);
+
+    for(int i = 0; i < 100; i++) {
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        if(connect(fd, (sockaddr *)&addr, sizeof(addr)) == 0) {
+            int one = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+            return fd;
+        }
+        close(fd);
+        usleep(20 * 1000);
+    }
+    return -1;
+}
+
+static bool pingPong(int fd, const char *msg, char *buf) {
+    if(write(fd, msg, MSG_SIZE) != MSG_SIZE) {
+        return false;
+    }
+    int got = 0;
+    while(got < MSG_SIZE) {
+        int n = read(fd, buf + got, MSG_SIZE - got);
+        if(n <= 0) {
+            return false;
+        }
+        got += n;
+    }
+    return true;
+}
+
+static uint64_t serverSyscalls(TcpServer::ptr server) {
+    uint64_t total = 0;
+    IOThreadPool::ptr pool = server->getIOThreadPool();
+    for(int i = 0; i < pool->getIOThreadPoolSize(); i++) {
+        total += pool->getIOThread(i)->getReactor()->getStats().poller_syscalls;
+    }
+    return total;
+}
+
+static void runClients(TcpServer::ptr server, ReactorBackend backend, const char *name, uint16_t port) {
+    std::vector<int> fds;
+    for(int i = 0; i < CLIENTS; i++) {
+        int fd = connectTo(port);
+        if(fd < 0) {
+            cout << name << ": connect failed" << endl;
+            _exit(1);
+        }
+        fds.push_back(fd);
+    }
+
+    /* 预热, 确保连接都已经分配到 IO 线程 */
+    char msg[MSG_SIZE];
+    char buf[MSG_SIZE];
+    memset(msg, 'a', sizeof(msg));
+    for(int i = 0; i < CLIENTS; i++) {
+        if(!pingPong(fds[i], msg, buf)) {
+            cout << name << ": warm up failed" << endl;
+            _exit(1);
+        }
+    }
+
+    ReactorBackend actual = server->getIOThreadPool()->getIOThread(0)->getReactor()->getBackend();
+    uint64_t syscalls_before = serverSyscalls(server);
+    std::atomic<int> failed(0);
+    int64_t start = nowNs();
+
+    std::vector<std::thread> threads;
+    for(int i = 0; i < CLIENTS; i++) {
+        threads.emplace_back([&, i]() {
+            char msg[MSG_SIZE];
+            char buf[MSG_SIZE];
+            memset(msg, 'a' + i % 26, sizeof(msg));
+            for(int j = 0; j < REQUESTS_PER_CLIENT; j++) {
+                if(!pingPong(fds[i], msg, buf) || memcmp(msg, buf, MSG_SIZE) != 0) {
+                    failed++;
+                    return ;
+                }
+            }
+        });
+    }
+    for(size_t i = 0; i < threads.size(); i++) {
+        threads[i].join();
+    }
+
+    int64_t cost = nowNs() - start;
+    uint64_t syscalls = serverSyscalls(server) - syscalls_before;
+    int64_t requests = (int64_t)CLIENTS * REQUESTS_PER_CLIENT;
+
+    cout << name << (actual == backend ? "" : " (fall back to epoll)")
+         << ": requests = " << requests
+         << ", failed clients = " << failed
+         << ", rps = " << (int64_t)(requests * 1e9 / cost)
+         << ", poller syscalls / request = " << (double)syscalls / requests << endl;
+    cout << Reactor::DumpAllStats() << flush;
+
+    /* TcpServer 没有 stop 接口, 直接退出子进程 */
+    _exit(0);
+}
+
+static void runBackend(ReactorBackend backend, const char *name, uint16_t port) {
+    Reactor::SetDefaultBackend(backend);
+
+    /* TcpServer 的 main reactor 属于构造它的线程, start() 也要在这个线程中调用 */
+    IPAddress::ptr addr = make_shared<IPAddress>("127.0.0.1", port);
+    TcpServer::ptr server = make_shared<TcpServer>(addr, TCP);
+
+    std::thread client_thread(runClients, server, backend, name, port);
+    client_thread.detach();
+
+    server->start();
+}
+
+int main() {
+    struct {
+        ReactorBackend backend;
+        const char *name;
+        uint16_t port;
+    } cases[] = {
+        { EpollBackend, "epoll", 9101 },
+        { IoUringBackend, "io_uring", 9102 },
+    };
+
+    for(size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        pid_t pid = fork();
+        if(pid == 0) {
+            runBackend(cases[i].backend, cases[i].name, cases[i].port);
+        }
+        int status = 0;
+        waitpid(pid, &status, 0);
+    }
+
+    return 0;
+}
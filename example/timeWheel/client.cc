@@ -9,8 +9,8 @@
 using namespace std;
 
 /**
- * 调整 tcpServer.cc 97 行创建 TimeWheel 的后两个参数
- * client connect 后，等待一段时间再发消息，时间轮到期后自动 clear 该连接
+ * server 用 TcpServer::setConnectionTimeout 设置了 5s 的 FirstByteTimeout
+ * client connect 后，等待 5s 以上再发消息，时间轮到期后自动 clear 该连接
 */
 int main() {
     int fd = socket(AF_INET, SOCK_STREAM, 0);
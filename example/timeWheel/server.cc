@@ -15,6 +15,9 @@ int main() {
     uint16_t port = 9000;
     IPAddress::ptr addr = make_shared<IPAddress>(ip, port);
     TcpServer::ptr server = make_shared<TcpServer>(addr, TCP);
+    /* 新连接 5s 内没有发消息, 或者之后空闲 10s, 就关闭 */
+    server->setConnectionTimeout(FirstByteTimeout, 5000);
+    server->setConnectionTimeout(IdleTimeout, 10000);
 
     server->start();
 
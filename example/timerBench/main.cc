@@ -0,0 +1,232 @@
+#include "timer.h"
+#include "reactor.h"
+
+#include <time.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <iostream>
+
+using namespace std;
+using namespace util;
+
+/*
+ * 模拟请求超时很多的场景: 同时挂着 TIMERS 个 1 ~ MAX_TIMEOUT_MS 毫秒的单次定时器,
+ * 每个到期后立即挂上一个新的, 运行 DURATION_MS 毫秒
+ * 分别用 TimerFdMode 和 LoopDrivenMode 的 reactor 运行, 输出到期的延迟分布和 reactor 的系统调用次数
+ * TimerFdMode 另外还有 poller 没有统计到的 timerfd_settime 和 read
+ * 最后一次同时有 2 个其他线程每毫秒向这个 reactor 的定时器提交 FOREIGN_BATCH 次 加入 + 取消, 看对到期处理的影响
+ *
+ * 另外对比两种定时器引擎在 1 万 / 10 万 / 100 万个定时器下的表现: 先挂上 n 个 10 ~ 60 秒的定时器,
+ * 然后取消一个再加一个 n 次, 推迟 n 次, 最后让 n 个定时器在 EXPIRE_SPAN_MS 内到期, 测一次全部取出执行的时间
+ *
+ * 以及不同的 slack 下, 同样一批定时器需要的唤醒次数和最大的延迟
+ */
+
+const int TIMERS = 1000;
+const int MAX_TIMEOUT_MS = 20;
+const int DURATION_MS = 2000;
+/* 其他线程每毫秒提交的 加入 + 取消 次数 */
+const int FOREIGN_BATCH = 100;
+
+const int EXPIRE_SPAN_MS = 100;
+
+const int SLACK_TIMERS = 2000;
+const int SLACK_SPAN_MS = 2000;
+
+/* 和定时器的到期时间用同一个时钟, 不走 reactor 线程的缓存 */
+static int64_t nowUs() {
+    timespec ts;
+    ::clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+struct BenchState {
+    Timer *timer;
+    unsigned int seed;
+    std::vector<int64_t> lateness_us;
+};
+
+static void addOne(BenchState *state) {
+    int64_t interval = 1 + rand_r(&state->seed) % MAX_TIMEOUT_MS;
+    std::shared_ptr<TimerEvent> event = std::make_shared<TimerEvent>(interval, false, nullptr);
+    TimerEvent *raw = event.get();
+    event->m_task = [state, raw]() {
+        state->lateness_us.push_back(nowUs() - raw->m_arrive_time * 1000);
+        addOne(state);
+    };
+    state->timer->addTimerEvent(event);
+}
+
+/* foreign_threads 个其他线程在 reactor 运行期间持续地 加入 + 取消 定时器 */
+static void runMode(TimerMode mode, const char *name, int foreign_threads) {
+    Reactor *reactor = Reactor::GetReactor();
+    reactor->setTimerMode(mode);
+
+    BenchState state;
+    state.timer = reactor->getTimer();
+    state.seed = 1;
+    for(int i = 0; i < TIMERS; i++) {
+        addOne(&state);
+    }
+
+    std::atomic<bool> stopped(false);
+    std::atomic<int64_t> foreign_ops(0);
+    std::vector<std::thread> foreigns;
+    for(int i = 0; i < foreign_threads; i++) {
+        foreigns.emplace_back([&state, &stopped, &foreign_ops]() {
+            while(!stopped) {
+                for(int j = 0; j < FOREIGN_BATCH; j++) {
+                    TimerEvent::ptr event = std::make_shared<TimerEvent>(MAX_TIMEOUT_MS, false, nullptr);
+                    state.timer->addTimerEvent(event);
+                    state.timer->delTimerEvent(event);
+                }
+                foreign_ops += FOREIGN_BATCH;
+                usleep(1000);
+            }
+        });
+    }
+
+    TimerEvent::ptr stop_event = std::make_shared<TimerEvent>(DURATION_MS, false, [reactor]() {
+        reactor->stop();
+    });
+    state.timer->addTimerEvent(stop_event);
+
+    uint64_t syscalls_before = reactor->getStats().poller_syscalls;
+    reactor->loop();
+    ReactorStats stats = reactor->getStats();
+
+    stopped = true;
+    for(size_t i = 0; i < foreigns.size(); i++) {
+        foreigns[i].join();
+    }
+    /* 退出 loop 后还没执行的命令 */
+    state.timer->applyCommands();
+
+    std::vector<int64_t> &lateness = state.lateness_us;
+    std::sort(lateness.begin(), lateness.end());
+    size_t count = lateness.size();
+    cout << name << ": fired = " << count
+         << ", lateness p50 = " << (count ? lateness[count / 2] : 0) << "us"
+         << ", p99 = " << (count ? lateness[count * 99 / 100] : 0) << "us"
+         << ", max = " << (count ? lateness.back() : 0) << "us"
+         << ", loops = " << stats.loop_count
+         << ", poller syscalls / timer = " << (count ? (double)(stats.poller_syscalls - syscalls_before) / count : 0);
+    if(foreign_threads > 0) {
+        cout << ", foreign add + del = " << foreign_ops * 1000 / DURATION_MS << " ops/s";
+    }
+    cout << endl;
+}
+
+static int64_t randomLongInterval(unsigned int *seed) {
+    return 10000 + rand_r(seed) % 50000;
+}
+
+static int64_t opsPerSecond(int64_t ops, int64_t us) {
+    return us > 0 ? (int64_t)((double)ops * 1000000 / us) : 0;
+}
+
+static void runEngine(TimerEngine engine, const char *name, int outstanding) {
+    /* 不运行 loop, 只测引擎本身 */
+    Timer timer(nullptr, LoopDrivenMode, engine);
+
+    unsigned int seed = 1;
+    std::vector<TimerHandle> handles(outstanding);
+    int64_t start = nowUs();
+    for(int i = 0; i < outstanding; i++) {
+        handles[i] = timer.addTimer(randomLongInterval(&seed), nullptr);
+    }
+    int64_t fill_us = nowUs() - start;
+
+    /* 请求结束, 取消它的超时, 新请求再挂一个 */
+    start = nowUs();
+    for(int i = 0; i < outstanding; i++) {
+        size_t index = rand_r(&seed) % outstanding;
+        timer.cancelTimer(handles[index]);
+        handles[index] = timer.addTimer(randomLongInterval(&seed), nullptr);
+    }
+    int64_t churn_us = nowUs() - start;
+
+    /* 连接有数据, 推迟空闲超时 */
+    start = nowUs();
+    for(int i = 0; i < outstanding; i++) {
+        timer.resetTimer(handles[rand_r(&seed) % outstanding], 60000);
+    }
+    int64_t reset_us = nowUs() - start;
+
+    for(int i = 0; i < outstanding; i++) {
+        timer.cancelTimer(handles[i]);
+    }
+
+    /* 同样多的定时器在 EXPIRE_SPAN_MS 内到期, 等全部到期后一次取出并执行 */
+    int fired = 0;
+    for(int i = 0; i < outstanding; i++) {
+        timer.addTimer(1 + rand_r(&seed) % EXPIRE_SPAN_MS, [&fired]() { fired++; });
+    }
+    usleep((EXPIRE_SPAN_MS + 10) * 1000);
+    start = nowUs();
+    timer.onTimer();
+    int64_t expire_us = nowUs() - start;
+
+    cout << name << " timers = " << outstanding
+         << ": add = " << opsPerSecond(outstanding, fill_us) << " ops/s"
+         << ", cancel + add = " << opsPerSecond(outstanding, churn_us) << " ops/s"
+         << ", postpone = " << opsPerSecond(outstanding, reset_us) << " ops/s"
+         << ", expire " << fired << " in " << expire_us / 1000 << "ms"
+         << endl;
+}
+
+/* SLACK_TIMERS 个单次定时器均匀分布在 SLACK_SPAN_MS 内, 统计 timerfd 唤醒的次数 */
+static void runSlack(int64_t slack) {
+    Reactor *reactor = Reactor::GetReactor();
+    reactor->setTimerMode(TimerFdMode);
+    Timer *timer = reactor->getTimer();
+
+    unsigned int seed = 1;
+    int64_t max_lateness_us = 0;
+    for(int i = 0; i < SLACK_TIMERS; i++) {
+        int64_t interval = 1 + rand_r(&seed) % SLACK_SPAN_MS;
+        int64_t arrive_us = nowUs() + interval * 1000;
+        timer->addTimer(interval, [arrive_us, &max_lateness_us]() {
+            max_lateness_us = std::max(max_lateness_us, nowUs() - arrive_us);
+        }, slack);
+    }
+    timer->addTimer(SLACK_SPAN_MS + 100, [reactor]() {
+        reactor->stop();
+    });
+
+    reactor->loop();
+    cout << "slack = " << slack << "ms: " << SLACK_TIMERS << " timers in " << SLACK_SPAN_MS << "ms"
+         << ", wakeups = " << reactor->getStats().loop_count
+         << ", max lateness = " << max_lateness_us / 1000 << "ms" << endl;
+}
+
+int main() {
+    /* 每种模式在单独的线程中运行, 各自有一个 Reactor */
+    std::thread timerfd_thread(runMode, TimerFdMode, "timerfd", 0);
+    timerfd_thread.join();
+
+    std::thread loop_thread(runMode, LoopDrivenMode, "loop driven", 0);
+    loop_thread.join();
+
+    std::thread foreign_thread(runMode, LoopDrivenMode, "loop driven, 2 foreign threads", 2);
+    foreign_thread.join();
+
+    int64_t slacks[] = { 0, 16, 100 };
+    for(int i = 0; i < 3; i++) {
+        std::thread slack_thread(runSlack, slacks[i]);
+        slack_thread.join();
+    }
+
+    int sizes[] = { 10000, 100000, 1000000 };
+    for(int i = 0; i < 3; i++) {
+        runEngine(HeapEngine, "heap ", sizes[i]);
+        runEngine(WheelEngine, "wheel", sizes[i]);
+    }
+
+    return 0;
+}
@@ -0,0 +1,49 @@
+#include "log.h"
+#include "timer.h"
+#include "reactor.h"
+#include "watchdog.h"
+
+#include <time.h>
+#include <memory>
+#include <iostream>
+#include <functional>
+
+using namespace std;
+using namespace util;
+
+/*
+ * 定时器回调中阻塞 300ms 模拟卡住的 reactor, watchdog 阈值 100ms
+ * 卡顿报告和调用栈写在日志文件中
+ */
+
+static int g_stall_times = 0;
+
+void blockingCallback() {
+    cout << "blocking callback start, now time = " << getNowMs() << endl;
+
+    /* nanosleep 没有被 hook, 会阻塞整个线程 */
+    timespec ts = { 0, 300 * 1000 * 1000 };
+    ::nanosleep(&ts, nullptr);
+
+    if(++g_stall_times == 3) {
+        cout << "watchdog stall count = " << ReactorWatchdog::GetWatchdog()->getStallCount() << endl;
+        Reactor::GetReactor()->stop();
+    }
+}
+
+int main() {
+    initLog("test_log");
+
+    Reactor *reactor = Reactor::GetReactor();
+    reactor->setReactorType(MainReactor);
+
+    ReactorWatchdog::GetWatchdog()->start(100);
+
+    Timer *timer = reactor->getTimer();
+    timer->addTimerEvent(make_shared<TimerEvent>(500, true, std::bind(blockingCallback)));
+
+    reactor->loop();
+
+    ReactorWatchdog::GetWatchdog()->stop();
+    return 0;
+}
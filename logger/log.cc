@@ -1,4 +1,5 @@
 #include "log.h"
+#include "clock.h"
 
 #include <unistd.h>
 #include <syscall.h>
@@ -109,7 +110,8 @@ void LogEvent::log() {
 }
 
 std::stringstream &LogEvent::getStringStream() {
-    ::gettimeofday(&m_timeval, nullptr);
+    /* 每条日志都要取一次时间, 用粗粒度的时钟 */
+    Clock::CoarseWallTime(&m_timeval);
 
     struct tm time;
     ::localtime_r(&(m_timeval.tv_sec), &time);
@@ -212,7 +214,7 @@ void *AsyncLogger::execute(void *arg) {
         ::pthread_mutex_unlock(&ptr->m_mutex);
 
         timeval now;
-        ::gettimeofday(&now, nullptr);
+        Clock::CoarseWallTime(&now);
 
         struct tm now_time;
         ::localtime_r(&(now.tv_sec), &now_time);
@@ -0,0 +1,177 @@
+#ifndef _MAILBOXGRID_H
+#define _MAILBOXGRID_H
+
+#include <deque>
+#include <memory>
+#include <vector>
+#include <functional>
+
+#include "log.h"
+#include "reactor.h"
+#include "spscRing.h"
+
+namespace util {
+
+/*
+ * reactor 之间的类型化消息通道: 每个有序的 (发送方, 接收方) reactor 对一个 SpscRing
+ * sendTo 只能在组内某个 reactor 的线程 (包括它上面的协程) 中调用, 消息先攒在 ring 里,
+ * 发送方这一轮 loop 结束、阻塞之前统一发布, 每个接收方只唤醒一次
+ * 接收方在每轮 loop 开头取出所有 ring 中的消息, 在自己的线程中调用 handler
+ * ring 满了先放到发送方本地的溢出队列, 下一次 flush 时再发, 消息不会丢也不会乱序
+ * 需要在组内的 reactor 开始 loop() 之前创建, 在它们停止之后析构
+ */
+template <class T>
+class MailboxGrid : public ReactorMailbox {
+public:
+    typedef std::shared_ptr<MailboxGrid> ptr;
+    typedef std::function<void(T &)> Handler;
+
+    /* ring_size 必须是 2 的幂 */
+    MailboxGrid(const std::vector<Reactor *> &reactors, Handler handler, size_t ring_size = 1024)
+        : m_reactors(reactors),
+          m_handler(handler),
+          m_dirty(reactors.size()) {
+
+        size_t size = m_reactors.size();
+        for(size_t i = 0; i < size * size; i++) {
+            m_channels.push_back(new Channel(ring_size));
+        }
+        for(size_t i = 0; i < size; i++) {
+            m_reactors[i]->addMailbox(this);
+        }
+    }
+
+    ~MailboxGrid() {
+        for(size_t i = 0; i < m_reactors.size(); i++) {
+            m_reactors[i]->delMailbox(this);
+        }
+        for(size_t i = 0; i < m_channels.size(); i++) {
+            delete m_channels[i];
+        }
+    }
+
+    /* 调用方所在的 reactor 或 dst 不在这个组里时返回 false */
+    bool sendTo(Reactor *dst, T msg) {
+        int src_index = indexOf(Reactor::GetCurrentReactor());
+        int dst_index = indexOf(dst);
+        if(src_index == -1 || dst_index == -1) {
+            LOG_ERROR << "MailboxGrid::sendTo reactor is not in this grid, src index = " << src_index
+                      << ", dst index = " << dst_index;
+            return false;
+        }
+
+        Channel *channel = getChannel(src_index, dst_index);
+        if(!channel->m_overflow.empty() || !channel->m_ring.push(std::move(msg))) {
+            channel->m_overflow.push_back(std::move(msg));
+        }
+        if(!channel->m_dirty) {
+            channel->m_dirty = true;
+            m_dirty[src_index].push_back(dst_index);
+        }
+        return true;
+    }
+
+    /* 不等这一轮结束, 立即发布当前线程攒下的消息 */
+    void flush() {
+        flush(Reactor::GetCurrentReactor());
+    }
+
+    int drain(Reactor *reactor) {
+        int dst_index = indexOf(reactor);
+        if(dst_index == -1) {
+            return 0;
+        }
+
+        int count = 0;
+        for(size_t src_index = 0; src_index < m_reactors.size(); src_index++) {
+            count += (int)getChannel(src_index, dst_index)->m_ring.consume(m_handler);
+        }
+        return count;
+    }
+
+    bool flush(Reactor *reactor) {
+        int src_index = indexOf(reactor);
+        if(src_index == -1 || m_dirty[src_index].empty()) {
+            return false;
+        }
+
+        std::vector<int> dirty;
+        dirty.swap(m_dirty[src_index]);
+
+        bool has_more = false;
+        for(size_t i = 0; i < dirty.size(); i++) {
+            int dst_index = dirty[i];
+            Channel *channel = getChannel(src_index, dst_index);
+
+            while(!channel->m_overflow.empty() && channel->m_ring.push(std::move(channel->m_overflow.front()))) {
+                channel->m_overflow.pop_front();
+            }
+
+            bool published = channel->m_ring.publish();
+            if(channel->m_overflow.empty()) {
+                channel->m_dirty = false;
+            } else {
+                /* 对端还没消费完, 下一轮再发 */
+                m_dirty[src_index].push_back(dst_index);
+                has_more = true;
+            }
+
+            if(published && m_reactors[dst_index] != reactor) {
+                m_reactors[dst_index]->wakeup();
+            }
+        }
+        return has_more;
+    }
+
+    bool hasPending(Reactor *reactor) {
+        int dst_index = indexOf(reactor);
+        if(dst_index == -1) {
+            return false;
+        }
+
+        for(size_t src_index = 0; src_index < m_reactors.size(); src_index++) {
+            if(!getChannel(src_index, dst_index)->m_ring.empty()) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+private:
+    struct Channel {
+        explicit Channel(size_t ring_size) : m_ring(ring_size), m_dirty(false) {}
+
+        SpscRing<T> m_ring;
+        /* 下面两个只有发送方线程访问 */
+        std::deque<T> m_overflow;
+        bool m_dirty;
+    };
+
+    MailboxGrid(const MailboxGrid &) = delete;
+    MailboxGrid &operator=(const MailboxGrid &) = delete;
+
+    /* 组内的 reactor 一般不超过 CPU 数, 线性查找就够了 */
+    int indexOf(Reactor *reactor) const {
+        for(size_t i = 0; i < m_reactors.size(); i++) {
+            if(m_reactors[i] == reactor) {
+                return (int)i;
+            }
+        }
+        return -1;
+    }
+
+    Channel *getChannel(size_t src_index, size_t dst_index) {
+        return m_channels[src_index * m_reactors.size() + dst_index];
+    }
+
+    std::vector<Reactor *> m_reactors;
+    Handler m_handler;
+    /* src * size + dst */
+    std::vector<Channel *> m_channels;
+    /* 下标是发送方, 这一轮有消息要发的接收方, 只有发送方线程访问 */
+    std::vector<std::vector<int>> m_dirty;
+};
+
+}   // namespace util
+
+#endif
@@ -0,0 +1,102 @@
+#ifndef _MPSCQUEUE_H
+#define _MPSCQUEUE_H
+
+#include <atomic>
+#include <stdint.h>
+
+namespace util {
+
+/* 侵入式节点, 需要入队的对象继承 MpscNode */
+struct MpscNode {
+    MpscNode() : m_next(nullptr) {}
+
+    std::atomic<MpscNode *> m_next;
+};
+
+/*
+ * 无锁 多生产者/单消费者 侵入式队列 (Vyukov MPSC)
+ * push / pushRange 可以在任意线程调用, pop 只能在唯一的消费者线程调用
+ * 生产者只做一次 exchange, 消费者不需要任何锁
+ */
+template <class T>
+class MpscQueue {
+public:
+    MpscQueue() : m_head(&m_stub), m_tail(&m_stub), m_size(0) {}
+
+    void push(T *node) {
+        pushRange(node, node, 1);
+    }
+
+    /* first -> ... -> last 已经通过 m_next 串好, 整段一次性入队 */
+    void pushRange(T *first, T *last, int count) {
+        last->m_next.store(nullptr, std::memory_order_relaxed);
+        m_size.fetch_add(count, std::memory_order_relaxed);
+        link(first, last);
+    }
+
+    /* 返回 nullptr 表示队列为空, 或者有生产者正在入队 (它之后会唤醒消费者) */
+    T *pop() {
+        MpscNode *tail = m_tail;
+        MpscNode *next = tail->m_next.load(std::memory_order_acquire);
+
+        if(tail == &m_stub) {
+            if(next == nullptr) {
+                return nullptr;
+            }
+            m_tail = next;
+            tail = next;
+            next = next->m_next.load(std::memory_order_acquire);
+        }
+
+        if(next) {
+            m_tail = next;
+            m_size.fetch_sub(1, std::memory_order_relaxed);
+            return static_cast<T *>(tail);
+        }
+
+        if(tail != m_head.load(std::memory_order_acquire)) {
+            return nullptr;
+        }
+
+        m_stub.m_next.store(nullptr, std::memory_order_relaxed);
+        link(&m_stub, &m_stub);
+
+        next = tail->m_next.load(std::memory_order_acquire);
+        if(next) {
+            m_tail = next;
+            m_size.fetch_sub(1, std::memory_order_relaxed);
+            return static_cast<T *>(tail);
+        }
+        return nullptr;
+    }
+
+    /* 近似值, 仅用于统计和判断是否需要继续处理 */
+    int64_t size() const {
+        int64_t size = m_size.load(std::memory_order_relaxed);
+        return size > 0 ? size : 0;
+    }
+
+    bool empty() const {
+        return size() == 0;
+    }
+
+private:
+    MpscQueue(const MpscQueue &) = delete;
+    MpscQueue &operator=(const MpscQueue &) = delete;
+
+    void link(MpscNode *first, MpscNode *last) {
+        MpscNode *prev = m_head.exchange(last, std::memory_order_acq_rel);
+        prev->m_next.store(first, std::memory_order_release);
+    }
+
+    std::atomic<MpscNode *> m_head;     // 生产者
+    char m_pad[64 - sizeof(std::atomic<MpscNode *>)];   // 生产者和消费者不共享 cache line
+    MpscNode *m_tail;                   // 消费者
+    MpscNode m_stub;
+
+    std::atomic<int64_t> m_size;
+};
+
+}   // namespace util
+
+#endif
@@ -0,0 +1,95 @@
+#include "log.h"
+#include "poller.h"
+#include "uringPoller.h"
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+namespace util {
+
+static int toTimeoutMs(int64_t timeout_ns) {
+    if(timeout_ns < 0) {
+        return -1;
+    }
+    int64_t timeout_ms = (timeout_ns + 999999) / 1000000;
+    return timeout_ms > INT32_MAX ? INT32_MAX : (int)timeout_ms;
+}
+
+/* 内核不支持 epoll_pwait2 (5.11 以下) 时置为 false, 之后都退回 epoll_wait */
+static std::atomic_bool g_has_epoll_pwait2(true);
+
+Poller *Poller::Create(ReactorBackend backend) {
+    if(backend == IoUringBackend) {
+        UringPoller *poller = new UringPoller();
+        if(poller->init()) {
+            return poller;
+        }
+        delete poller;
+        return nullptr;
+    }
+
+    EpollPoller *poller = new EpollPoller();
+    if(poller->init()) {
+        return poller;
+    }
+    delete poller;
+    return nullptr;
+}
+
+int Poller::waitNs(epoll_event *events, int max_events, int64_t timeout_ns) {
+    return wait(events, max_events, toTimeoutMs(timeout_ns));
+}
+
+
+EpollPoller::EpollPoller() : m_epfd(-1) {}
+
+EpollPoller::~EpollPoller() {
+    if(m_epfd != -1) {
+        ::close(m_epfd);
+    }
+}
+
+bool EpollPoller::init() {
+    if((m_epfd = ::epoll_create(1)) <= 0) {
+        LOG_ERROR << "epoll_create error, sys error=" << strerror(errno);
+        return false;
+    }
+    return true;
+}
+
+int EpollPoller::ctl(int op, int fd, epoll_event *event) {
+    countSyscall();
+    return ::epoll_ctl(m_epfd, op, fd, event);
+}
+
+int EpollPoller::wait(epoll_event *events, int max_events, int timeout_ms) {
+    countSyscall();
+    return ::epoll_wait(m_epfd, events, max_events, timeout_ms);
+}
+
+int EpollPoller::waitNs(epoll_event *events, int max_events, int64_t timeout_ns) {
+    /* 整毫秒的超时 epoll_wait 就够了 */
+    if(timeout_ns <= 0 || timeout_ns % 1000000 == 0 || !g_has_epoll_pwait2.load(std::memory_order_relaxed)) {
+        return wait(events, max_events, toTimeoutMs(timeout_ns));
+    }
+
+#ifdef __NR_epoll_pwait2
+    timespec ts;
+    ts.tv_sec = timeout_ns / 1000000000;
+    ts.tv_nsec = timeout_ns % 1000000000;
+
+    countSyscall();
+    int rt = (int)::syscall(__NR_epoll_pwait2, m_epfd, events, max_events, &ts, nullptr, 0);
+    if(rt >= 0 || errno != ENOSYS) {
+        return rt;
+    }
+    LOG_INFO << "epoll_pwait2 is not supported, fall back to epoll_wait";
+#endif
+
+    g_has_epoll_pwait2 = false;
+    return wait(events, max_events, toTimeoutMs(timeout_ns));
+}
+
+}   // namespace util
\ No newline at end of file
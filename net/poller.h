@@ -0,0 +1,75 @@
+#ifndef _POLLER_H
+#define _POLLER_H
+
+#include <atomic>
+#include <stdint.h>
+#include <sys/epoll.h>
+
+namespace util {
+
+enum ReactorBackend {
+    EpollBackend = 1,
+    IoUringBackend = 2
+};
+
+/*
+ * Reactor 使用的 IO 多路复用后端, 接口保持 epoll 的语义:
+ * ctl() 对应 epoll_ctl, wait() 对应 epoll_wait, 返回的 epoll_event.data 就是注册时传入的 data
+ * 只能在 reactor 的 loop 线程中调用
+ */
+class Poller {
+public:
+    Poller() : m_syscalls(0) {}
+    virtual ~Poller() {}
+
+    virtual ReactorBackend getBackend() const = 0;
+
+    /* 失败返回 -1 并设置 errno, 和 epoll_ctl 一致 (ADD 已存在为 EEXIST, MOD/DEL 不存在为 ENOENT) */
+    virtual int ctl(int op, int fd, epoll_event *event) = 0;
+    virtual int wait(epoll_event *events, int max_events, int timeout_ms) = 0;
+    /*
+     * timeout_ns < 0 表示一直等待; 后端支持时精确到纳秒 (epoll_pwait2 / io_uring 的 timespec),
+     * 否则向上取整到毫秒调用 wait()
+     */
+    virtual int waitNs(epoll_event *events, int max_events, int64_t timeout_ns);
+
+    /* 后端自己发起的系统调用次数 (epoll_ctl / epoll_wait / io_uring_enter) */
+    uint64_t getSyscallCount() const {
+        return m_syscalls.load(std::memory_order_relaxed);
+    }
+
+    /* 创建失败时返回 nullptr */
+    static Poller *Create(ReactorBackend backend);
+
+protected:
+    void countSyscall() {
+        m_syscalls.store(m_syscalls.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+
+private:
+    std::atomic<uint64_t> m_syscalls;
+};
+
+
+class EpollPoller : public Poller {
+public:
+    EpollPoller();
+    ~EpollPoller();
+
+    bool init();
+
+    ReactorBackend getBackend() const {
+        return EpollBackend;
+    }
+
+    int ctl(int op, int fd, epoll_event *event);
+    int wait(epoll_event *events, int max_events, int timeout_ms);
+    int waitNs(epoll_event *events, int max_events, int64_t timeout_ns);
+
+private:
+    int m_epfd;
+};
+
+}   // namespace util
+
+#endif
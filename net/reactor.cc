@@ -1,9 +1,11 @@
 #include "log.h"
+#include "clock.h"
 #include "timer.h"
 #include "reactor.h"
 #include "coroutineHook.h"
 
 #include <errno.h>
+#include <time.h>
 #include <string.h>
 #include <assert.h>
 #include <algorithm>
@@ -16,8 +18,29 @@ extern write_fun_ptr_t g_sys_write_fun;
 namespace util {
 
 static thread_local int t_max_epoll_timeout = 10000;
+
+static const int DEFAULT_MIN_EVENTS = 16;
+static const int DEFAULT_MAX_EVENTS = 4096;
+/* 连续这么多轮就绪数都不足数组的 1/4, 就把数组减半 */
+static const int SHRINK_AFTER_TURNS = 64;
+/* 自旋预算降到 0 之后, 阻塞等到事件时重新给的预算 */
+static const int MIN_SPIN_US = 4;
+
+/* 只在 loop 线程调用, 顺便刷新这个线程缓存的时间 */
+static int64_t getMonotonicUs() {
+    return Clock::Refresh() / 1000;
+}
+/* 只有 loop 线程写的计数器, 不需要原子的读-改-写 */
+static void addCounter(std::atomic<uint64_t> &counter, uint64_t value) {
+    counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+}
+
 static thread_local Reactor *t_reactor_ptr = nullptr;
-static CoroutineTaskQueue *t_coroutine_task_queue = nullptr;
+static Mutex g_reactors_mutex;
+static std::vector<Reactor *> g_reactors;
+static std::atomic<int> g_default_backend(EpollBackend);
+static std::atomic<int> g_default_timer_mode(TimerFdMode);
+static std::atomic<int> g_default_timer_engine(HeapEngine);
 
 Reactor *Reactor::GetReactor() {
     if(t_reactor_ptr == nullptr) {
@@ -26,11 +49,67 @@ Reactor *Reactor::GetReactor() {
     return t_reactor_ptr;
 }
 
-Reactor::Reactor()
-    : m_stop_flag(false),
+Reactor *Reactor::GetCurrentReactor() {
+    return t_reactor_ptr;
+}
+
+void Reactor::SetDefaultBackend(ReactorBackend backend) {
+    g_default_backend = backend;
+}
+
+void Reactor::SetDefaultTimerMode(TimerMode mode) {
+    g_default_timer_mode = mode;
+}
+
+void Reactor::SetDefaultTimerEngine(TimerEngine engine) {
+    g_default_timer_engine = engine;
+}
+
+Reactor::Reactor() : Reactor((ReactorBackend)g_default_backend.load()) {}
+
+Reactor::Reactor(ReactorBackend backend)
+    : m_poller(nullptr),
+      m_timer_fd(-1),
+      m_stop_flag(false),
       m_is_looping(false),
       is_init_timer(false),
-      m_timer(nullptr) {
+      m_fd_size(0),
+      m_max_tasks_per_turn(0),
+      m_max_resumes_per_turn(0),
+      m_time_slice_us(0),
+      m_timer(nullptr),
+      m_timer_mode((TimerMode)g_default_timer_mode.load()),
+      m_timer_engine((TimerEngine)g_default_timer_engine.load()),
+      m_min_events(DEFAULT_MIN_EVENTS),
+      m_max_events(DEFAULT_MAX_EVENTS),
+      m_sparse_turns(0),
+      m_loop_count(0),
+      m_ready_events(0),
+      m_last_ready(0),
+      m_max_ready(0),
+      m_event_capacity(0),
+      m_wakeup_pending(false),
+      m_wakeup_writes(0),
+      m_suppressed_wakeups(0),
+      m_max_spin_us(0),
+      m_sock_busy_poll_us(0),
+      m_spin_budget_us(0),
+      m_busy_poll_hits(0),
+      m_busy_poll_misses(0),
+      m_tasks_run(0),
+      m_coroutine_resumes(0),
+      m_task_budget_hits(0),
+      m_resume_budget_hits(0),
+      m_time_slice_hits(0),
+      m_last_turn_tasks(0),
+      m_carried_tasks(0),
+      m_wakeups_received(0),
+      m_ctl_calls(0),
+      m_mailbox_messages(0),
+      m_turn_resumes(0),
+      m_busy_since_us(0),
+      m_running_cor_id(-1),
+      m_running_callback(nullptr) {
 
     if(t_reactor_ptr != nullptr) {
         LOG_ERROR << "this thread[" << m_tid << "] has already create a reactor";
@@ -41,8 +120,13 @@ Reactor::Reactor()
 
     t_reactor_ptr = this;
 
-    if((m_epfd = ::epoll_create(1)) <= 0) {
-        LOG_ERROR << "start server error. epoll_create error, sys error=" << strerror(errno);
+    m_poller = Poller::Create(backend);
+    if(m_poller == nullptr && backend != EpollBackend) {
+        LOG_ERROR << "create poller backend [" << backend << "] failed, fall back to epoll";
+        m_poller = Poller::Create(EpollBackend);
+    }
+    if(m_poller == nullptr) {
+        LOG_ERROR << "start server error. create poller failed";
         Exit(0);
     }
 
@@ -51,13 +135,33 @@ Reactor::Reactor()
         Exit(0);
     }
 
-    LOG_DEBUG << "m_epfd = " << m_epfd << ", m_wake_fd = " << m_wake_fd;
+    LOG_DEBUG << "poller backend = " << m_poller->getBackend() << ", m_wake_fd = " << m_wake_fd;
+
+    m_events.resize(m_min_events);
+    m_event_capacity = m_min_events;
     
     addWakeupFd();
+
+    Mutex::Lock lock(g_reactors_mutex);
+    g_reactors.push_back(this);
 }
 
 Reactor::~Reactor() {
-    ::close(m_epfd);
+    Mutex::Lock lock(g_reactors_mutex);
+    g_reactors.erase(std::remove(g_reactors.begin(), g_reactors.end(), this), g_reactors.end());
+    lock.unlock();
+
+    TaskNode *node = nullptr;
+    while((node = m_pending_tasks.pop()) != nullptr) {
+        delete node;
+    }
+    for(size_t i = 0; i < m_running_tasks.size(); i++) {
+        delete m_running_tasks[i];
+    }
+    m_running_tasks.clear();
+
+    delete m_poller;
+    m_poller = nullptr;
     if(m_timer) {
         delete m_timer;
         m_timer = nullptr;
@@ -76,12 +180,10 @@ void Reactor::addEvent(int fd, epoll_event event, bool is_wakeup /*= true*/) {
         return ;
     }
 
-    {
-        Mutex::Lock lock(m_mutex);
-        m_pending_add_fds.insert(std::pair<int, epoll_event>(fd, event));
-    }
-
-    if(is_wakeup) wakeup();
+    auto task = [this, fd, event]() {
+        addEventInLoopThread(fd, event);
+    };
+    addTask(task, is_wakeup);
 }
 
 void Reactor::delEvent(int fd, bool is_wakeup /*= true*/) {
@@ -95,38 +197,50 @@ void Reactor::delEvent(int fd, bool is_wakeup /*= true*/) {
         return ;
     }
 
-    {
-        Mutex::Lock lock(m_mutex);
-        m_pending_del_fds.push_back(fd);
-    }
-
-    if(is_wakeup) wakeup();
+    auto task = [this, fd]() {
+        delEventInLoopThread(fd);
+    };
+    addTask(task, is_wakeup);
 }
 
 void Reactor::addTask(std::function<void()> task, bool is_wakeup /*= true*/) {
-    {
-        Mutex::Lock lock(m_mutex);
-        m_pending_tasks.push_back(task);
-    }
+    TaskNode *node = new TaskNode();
+    node->m_task = std::move(task);
+    m_pending_tasks.push(node);
 
     if(is_wakeup) wakeup();
 }
 
 void Reactor::addTask(std::vector<std::function<void()>> task, bool is_wakeup /*= true*/) {
-    {
-        Mutex::Lock lock(m_mutex);
-        m_pending_tasks.insert(m_pending_tasks.begin(), task.begin(), task.end());
+    if(task.empty()) {
+        return ;
     }
 
+    /* 先在本地串成链表, 再一次性入队, 保证这一批 task 在队列中是连续的 */
+    TaskNode *first = nullptr;
+    TaskNode *last = nullptr;
+    for(size_t i = 0; i < task.size(); i++) {
+        TaskNode *node = new TaskNode();
+        node->m_task = std::move(task[i]);
+        if(last) {
+            last->m_next.store(node, std::memory_order_relaxed);
+        } else {
+            first = node;
+        }
+        last = node;
+    }
+    m_pending_tasks.pushRange(first, last, (int)task.size());
+
     if(is_wakeup) wakeup();
 }
 
 void Reactor::addCoroutine(Coroutine::ptr cor, bool is_wakeup /*= true*/) {
-    auto func = [cor]() {
-        Coroutine::Resume(cor.get());
+    /* 显式把协程交给这个 reactor, 之后它的 IO 等待都在这个 reactor 上 */
+    auto func = [this, cor]() {
+        resumeCoroutine(cor.get());
     };
 
-    addTask(func);
+    addTask(func, is_wakeup);
 }
 
 void Reactor::wakeup() {
@@ -134,6 +248,13 @@ void Reactor::wakeup() {
         return ;
     }
 
+    /* 只有 false -> true 的那一次需要真正写 eventfd */
+    if(m_wakeup_pending.exchange(true)) {
+        m_suppressed_wakeups.fetch_add(1, std::memory_order_relaxed);
+        return ;
+    }
+
+    m_wakeup_writes.fetch_add(1, std::memory_order_relaxed);
     uint64_t tmp = 1;
     if(g_sys_write_fun(m_wake_fd, &tmp, 8) != 8) {
         LOG_ERROR << "write wakeupfd[" << m_wake_fd << "] error";
@@ -147,82 +268,76 @@ void Reactor::loop() {
 
     m_is_looping = true;
     m_stop_flag = false;
+    m_busy_since_us.store(getMonotonicUs(), std::memory_order_relaxed);
     
-    Coroutine *fir_cor = nullptr;
     while(!m_stop_flag) {
-        const int MAX_EVENTS = 10;
-        epoll_event re_events[MAX_EVENTS];
-
-        if(fir_cor) {
-            Coroutine::Resume(fir_cor);
-            fir_cor = nullptr;
-        }
-
-        if(m_reactor_type != MainReactor) {
-            FdEvent *ptr = nullptr;
-            while(1) {
-                ptr = CoroutineTaskQueue::GetCoroutineTaskQueue()->pop();
-                if(ptr) {
-                    ptr->setReactor(this);
-                    Coroutine::Resume(ptr->getCoroutine()); 
-                } else {
-                    break;
-                }
-            }
-        }
-
-        Mutex::Lock lock(m_mutex);
-        std::vector<std::function<void()>> tmp_tasks;
-        tmp_tasks.swap(m_pending_tasks);
-        lock.unlock();
-
-        for(size_t i = 0; i < tmp_tasks.size(); i++) {
-            if(tmp_tasks[i]) tmp_tasks[i]();
-        }
-
-        int rt = ::epoll_wait(m_epfd, re_events, MAX_EVENTS, t_max_epoll_timeout);
+        int64_t turn_start = m_time_slice_us.load(std::memory_order_relaxed) > 0 ? getMonotonicUs() : 0;
+        bool has_more = resumeReadyCoroutines(turn_start);
+
+        /* 先清除唤醒标记再取消息和 task, 之后入队的生产者会重新写 eventfd */
+        m_wakeup_pending.exchange(false);
+
+        drainMailboxes();
+        has_more = runTasks(turn_start) || has_more;
+        /* 这一轮发给其他 reactor 的消息, 每个接收方只唤醒一次 */
+        has_more = flushMailboxes() || has_more;
+
+        /* 还有留下的工作时只检查一下 IO 事件, 不阻塞 */
+        int64_t work_end = getMonotonicUs();
+        m_work_us.record(work_end - m_busy_since_us.load(std::memory_order_relaxed));
+        m_resumes_per_turn.record(m_turn_resumes);
+        m_turn_resumes = 0;
+
+        m_busy_since_us.store(0, std::memory_order_relaxed);
+        int rt = waitEvents(getWaitTimeoutNs(has_more));
+        int64_t now = getMonotonicUs();
+        m_poll_wait_us.record(now - work_end);
+        m_busy_since_us.store(now, std::memory_order_relaxed);
         LOG_DEBUG << "epoll_wait rt = " << rt << ", thread id = " << m_tid;
         if(rt < 0) {
             LOG_ERROR << "epoll_wait error, thread id = " << m_tid << ", errno = " << strerror(errno);
         } else {
+            m_loop_count.store(m_loop_count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            m_ready_events.store(m_ready_events.load(std::memory_order_relaxed) + rt, std::memory_order_relaxed);
+            m_last_ready.store(rt, std::memory_order_relaxed);
+            m_ready_per_turn.record(rt);
+            if(rt > m_max_ready.load(std::memory_order_relaxed)) {
+                m_max_ready.store(rt, std::memory_order_relaxed);
+            }
+
             for(int i = 0; i < rt; i++) {
-                epoll_event event = re_events[i];
+                epoll_event event = m_events[i];
                 if(event.data.fd == m_wake_fd && (event.events & READ)) {
                     LOG_DEBUG << "epoll wake up, fd = [" << m_wake_fd << "], thread id = " << m_tid;
-                    char buf[8];
-                    while(1) {
-                        if((g_sys_read_fun(m_wake_fd, buf, 8) == -1) && errno == EAGAIN) {
-                            break;
-                        }
+                    /* eventfd 一次 read 就会把计数清零, 不需要循环读到 EAGAIN */
+                    uint64_t count = 0;
+                    addCounter(m_wakeups_received, 1);
+                    if(g_sys_read_fun(m_wake_fd, &count, 8) != 8 && errno != EAGAIN) {
+                        LOG_ERROR << "read wakeupfd[" << m_wake_fd << "] error, sys error=" << strerror(errno);
                     }
                 } else {
                     FdEvent *ptr = (FdEvent *)event.data.ptr;
-                    if(ptr != nullptr) {
+                    if(ptr != nullptr && ptr->isPersistent()) {
+                        /* 边缘触发常驻注册的 fd, 只有协程正在等待对应事件时才 resume */
+                        Coroutine *cor = ptr->getCoroutine();
+                        int wait_events = ptr->getWaitEvents();
+                        if(cor && (event.events & (wait_events | EPOLLERR | EPOLLHUP | EPOLLRDHUP))) {
+                            ptr->setWaitEvents(0);
+                            resumeCoroutine(cor);
+                        }
+                    } else if(ptr != nullptr) {
                         int fd = ptr->getFd();
-                        if(!(event.events & EPOLLIN && !(event.events & EPOLLOUT))) {
+                        if(!(event.events & (EPOLLIN | EPOLLOUT))) {
                             LOG_ERROR << "socket [" << fd << "] occur other unknow event:[" << event.events << "], need unregister this socket, thread id =" << m_tid;
                             delEventInLoopThread(fd);
                         } else {
                             if(ptr->getCoroutine()) {
-                                if(!fir_cor) {
-                                    LOG_DEBUG << "fir_cor is not null, so fir_cor execute, threa id = " << m_tid;
-                                    fir_cor = ptr->getCoroutine();
-                                    continue;
-                                }
-
-                                if(m_reactor_type == SubReactor) {
-                                    LOG_DEBUG << "reactor type is SubReactor, thread id = " << m_tid;
-                                    delEventInLoopThread(fd);
-                                    ptr->setReactor(nullptr);
-                                    CoroutineTaskQueue::GetCoroutineTaskQueue()->push(ptr);
-                                } else {
-                                    LOG_DEBUG << "reactor type is MainReactor, thread id = " << m_tid;
-                                    Coroutine::Resume(ptr->getCoroutine());
-                                    if(fir_cor) {
-                                        fir_cor = nullptr;
-                                    }
-                                }
-
+                                /*
+                                 * 协程留在拥有这个 fd 的 reactor 上, 放入本地就绪队列, 下一轮开头恢复
+                                 * 先把协程从 FdEvent 上摘下来, 恢复之前再次就绪不会重复入队
+                                 */
+                                m_ready_coroutines.push_back(ptr->getCoroutine());
+                                ptr->clearCoroutine();
                             } else {
                                 LOG_DEBUG << "epoll timer event, thread id = " << m_tid;
                                 std::function<void()> read_callback;
@@ -231,48 +346,32 @@ void Reactor::loop() {
                                 write_callback = ptr->getCallBack(WRITE);
                                 LOG_DEBUG << "fd = " << fd << ", m_timer_fd = " << m_timer_fd << ", now time = " << getNowMs();
                                 if(fd == m_timer_fd) {
-                                    read_callback();
+                                    runCallback(read_callback);
                                     continue;
                                 }
 
-                                if (event.events & EPOLLIN) {
-                                    Mutex::Lock lock(m_mutex);
-                                    m_pending_tasks.push_back(read_callback);
-                                    lock.unlock();					
+                                if ((event.events & EPOLLIN) && read_callback) {
+                                    addTask(read_callback, false);
                                 }
-                                if (event.events & EPOLLOUT) {
-                                    Mutex::Lock lock(m_mutex);
-                                    m_pending_tasks.push_back(write_callback);
-                                    lock.unlock();						
+                                if ((event.events & EPOLLOUT) && write_callback) {
+                                    addTask(write_callback, false);
                                 }
                             }
                         }
                     } 
                 }
             }
-        }
 
-        std::map<int, epoll_event> tmp_add;
-        std::vector<int> tmp_del;
-
-        {
-            Mutex::Lock lock(m_mutex);
-            tmp_add.swap(m_pending_add_fds);
-            tmp_del.swap(m_pending_del_fds);
+            adjustEventBatch(rt);
         }
 
-        for(auto it = tmp_add.begin(); it != tmp_add.end(); it++) {
-            LOG_DEBUG << "Thread [" << m_tid << "], execute addEventInLoopThread";
-            addEventInLoopThread(it->first, it->second);
-        }
-        for(auto it = tmp_del.begin(); it != tmp_del.end(); it++) {
-            LOG_DEBUG << "Thread [" << m_tid << "], execute delEventInLoopThread";
-            delEventInLoopThread(*it);
-        }
+        runExpiredTimers();
     }
 
     LOG_DEBUG << "Thread [" << m_tid << "], reactor loop end";
+    m_busy_since_us.store(0, std::memory_order_relaxed);
     m_is_looping = false;
+    Clock::DisableCache();
 }
 
 void Reactor::stop() {
@@ -284,12 +383,36 @@ void Reactor::stop() {
 
 Timer *Reactor::getTimer() {
     if(m_timer == nullptr) {
-        m_timer = new Timer(this);
+        m_timer = new Timer(this, m_timer_mode, m_timer_engine);
         m_timer_fd = m_timer->getFd();
     }
     return m_timer;
 }
 
+void Reactor::setTimerMode(TimerMode mode) {
+    if(m_timer != nullptr) {
+        LOG_ERROR << "Reactor::setTimerMode timer has already been created, mode = " << m_timer->getMode();
+        return ;
+    }
+    m_timer_mode = mode;
+}
+
+TimerMode Reactor::getTimerMode() const {
+    return m_timer_mode;
+}
+
+void Reactor::setTimerEngine(TimerEngine engine) {
+    if(m_timer != nullptr) {
+        LOG_ERROR << "Reactor::setTimerEngine timer has already been created, engine = " << m_timer->getEngine();
+        return ;
+    }
+    m_timer_engine = engine;
+}
+
+TimerEngine Reactor::getTimerEngine() const {
+    return m_timer_engine;
+}
+
 pid_t Reactor::getTid() {
     return m_tid;
 }
@@ -298,44 +421,416 @@ void Reactor::setReactorType(ReactorType type) {
     m_reactor_type = type;
 }
 
+void Reactor::setEventBatchSize(int init_size, int max_size) {
+    if(init_size <= 0 || max_size < init_size) {
+        LOG_ERROR << "Reactor::setEventBatchSize invalid size, init_size = " << init_size << ", max_size = " << max_size;
+        return ;
+    }
+
+    m_min_events = init_size;
+    m_max_events = max_size;
+    m_sparse_turns = 0;
+    m_events.resize(m_min_events);
+    m_event_capacity = m_min_events;
+}
+
+ReactorStats Reactor::getStats() const {
+    ReactorStats stats;
+    stats.loop_count = m_loop_count.load(std::memory_order_relaxed);
+    stats.ready_events = m_ready_events.load(std::memory_order_relaxed);
+    stats.last_ready = m_last_ready.load(std::memory_order_relaxed);
+    stats.max_ready = m_max_ready.load(std::memory_order_relaxed);
+    stats.event_capacity = m_event_capacity.load(std::memory_order_relaxed);
+    stats.wakeup_writes = m_wakeup_writes.load(std::memory_order_relaxed);
+    stats.suppressed_wakeups = m_suppressed_wakeups.load(std::memory_order_relaxed);
+    stats.busy_poll_hits = m_busy_poll_hits.load(std::memory_order_relaxed);
+    stats.busy_poll_misses = m_busy_poll_misses.load(std::memory_order_relaxed);
+    stats.spin_budget_us = m_spin_budget_us.load(std::memory_order_relaxed);
+    stats.poller_syscalls = m_poller->getSyscallCount();
+    stats.tasks_run = m_tasks_run.load(std::memory_order_relaxed);
+    stats.coroutine_resumes = m_coroutine_resumes.load(std::memory_order_relaxed);
+    stats.task_budget_hits = m_task_budget_hits.load(std::memory_order_relaxed);
+    stats.resume_budget_hits = m_resume_budget_hits.load(std::memory_order_relaxed);
+    stats.time_slice_hits = m_time_slice_hits.load(std::memory_order_relaxed);
+    stats.last_turn_tasks = m_last_turn_tasks.load(std::memory_order_relaxed);
+    stats.carried_tasks = m_carried_tasks.load(std::memory_order_relaxed);
+    stats.tid = m_tid;
+    stats.backend = m_poller->getBackend();
+    stats.wakeups_received = m_wakeups_received.load(std::memory_order_relaxed);
+    stats.poller_ctl_calls = m_ctl_calls.load(std::memory_order_relaxed);
+    stats.mailbox_messages = m_mailbox_messages.load(std::memory_order_relaxed);
+    stats.poll_wait_us = m_poll_wait_us.snapshot();
+    stats.work_us = m_work_us.snapshot();
+    stats.ready_per_turn = m_ready_per_turn.snapshot();
+    stats.queue_depth = m_queue_depth.snapshot();
+    stats.resumes_per_turn = m_resumes_per_turn.snapshot();
+    return stats;
+}
+
+void Reactor::setBusyPoll(int max_spin_us, int sock_busy_poll_us /*= 0*/) {
+    if(max_spin_us < 0 || sock_busy_poll_us < 0) {
+        LOG_ERROR << "Reactor::setBusyPoll invalid param, max_spin_us = " << max_spin_us
+                  << ", sock_busy_poll_us = " << sock_busy_poll_us;
+        return ;
+    }
+
+    m_max_spin_us = max_spin_us;
+    m_sock_busy_poll_us = sock_busy_poll_us;
+    m_spin_budget_us = max_spin_us;
+}
+
+int Reactor::getSockBusyPoll() const {
+    return m_sock_busy_poll_us;
+}
+
+void Reactor::setLoopBudget(int max_tasks, int max_resumes, int time_slice_us /*= 0*/) {
+    if(max_tasks < 0 || max_resumes < 0 || time_slice_us < 0) {
+        LOG_ERROR << "Reactor::setLoopBudget invalid param, max_tasks = " << max_tasks
+                  << ", max_resumes = " << max_resumes << ", time_slice_us = " << time_slice_us;
+        return ;
+    }
+
+    m_max_tasks_per_turn = max_tasks;
+    m_max_resumes_per_turn = max_resumes;
+    m_time_slice_us = time_slice_us;
+}
+
+void Reactor::addMailbox(ReactorMailbox *mailbox) {
+    if(std::find(m_mailboxes.begin(), m_mailboxes.end(), mailbox) == m_mailboxes.end()) {
+        m_mailboxes.push_back(mailbox);
+    }
+}
+
+void Reactor::delMailbox(ReactorMailbox *mailbox) {
+    m_mailboxes.erase(std::remove(m_mailboxes.begin(), m_mailboxes.end(), mailbox), m_mailboxes.end());
+}
+
+ReactorBackend Reactor::getBackend() const {
+    return m_poller->getBackend();
+}
+
+ReactorHeartbeat Reactor::getHeartbeat() const {
+    ReactorHeartbeat heartbeat;
+    heartbeat.tid = m_tid;
+    heartbeat.busy_since_us = m_busy_since_us.load(std::memory_order_relaxed);
+    heartbeat.loop_count = m_loop_count.load(std::memory_order_relaxed);
+    heartbeat.coroutine_id = m_running_cor_id.load(std::memory_order_relaxed);
+    heartbeat.callback = m_running_callback.load(std::memory_order_relaxed);
+    return heartbeat;
+}
+
+std::string Reactor::DumpAllStats() {
+    std::string result;
+    ForEachReactor([&result](Reactor *reactor) {
+        result += reactor->getStats().toString();
+    });
+    return result;
+}
+
+void Reactor::ForEachReactor(std::function<void(Reactor *)> cb) {
+    Mutex::Lock lock(g_reactors_mutex);
+    for(size_t i = 0; i < g_reactors.size(); i++) {
+        cb(g_reactors[i]);
+    }
+}
+
+void Reactor::resumeCoroutine(Coroutine *cor) {
+    m_turn_resumes++;
+    addCounter(m_coroutine_resumes, 1);
+    m_running_cor_id.store(cor->getCorId(), std::memory_order_relaxed);
+    m_running_callback.store(cor->m_callback ? cor->m_callback.target_type().name() : nullptr, std::memory_order_relaxed);
+
+    Coroutine::Resume(cor);
+
+    m_running_cor_id.store(-1, std::memory_order_relaxed);
+    m_running_callback.store(nullptr, std::memory_order_relaxed);
+}
+
+void Reactor::runCallback(const std::function<void()> &cb) {
+    m_running_callback.store(cb.target_type().name(), std::memory_order_relaxed);
+    cb();
+    m_running_callback.store(nullptr, std::memory_order_relaxed);
+}
+
+void Reactor::drainMailboxes() {
+    for(size_t i = 0; i < m_mailboxes.size(); i++) {
+        addCounter(m_mailbox_messages, m_mailboxes[i]->drain(this));
+    }
+}
+
+bool Reactor::flushMailboxes() {
+    bool has_more = false;
+    for(size_t i = 0; i < m_mailboxes.size(); i++) {
+        has_more = m_mailboxes[i]->flush(this) || has_more;
+    }
+    return has_more;
+}
+
+bool Reactor::hasPendingWork() {
+    if(!m_pending_tasks.empty()) {
+        return true;
+    }
+    for(size_t i = 0; i < m_mailboxes.size(); i++) {
+        if(m_mailboxes[i]->hasPending(this)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool Reactor::isTimeSliceExhausted(int64_t turn_start) {
+    int time_slice = m_time_slice_us.load(std::memory_order_relaxed);
+    return time_slice > 0 && getMonotonicUs() - turn_start >= time_slice;
+}
+
+bool Reactor::resumeReadyCoroutines(int64_t turn_start) {
+    int max_resumes = m_max_resumes_per_turn.load(std::memory_order_relaxed);
+    int resumes = 0;
+    bool has_more = false;
+
+    while(!m_ready_coroutines.empty()) {
+        if(max_resumes > 0 && resumes >= max_resumes) {
+            addCounter(m_resume_budget_hits, 1);
+            has_more = true;
+            break;
+        }
+        if(isTimeSliceExhausted(turn_start)) {
+            addCounter(m_time_slice_hits, 1);
+            has_more = true;
+            break;
+        }
+
+        Coroutine *cor = m_ready_coroutines.front();
+        m_ready_coroutines.pop_front();
+        resumeCoroutine(cor);
+        resumes++;
+    }
+
+    return has_more;
+}
+
+bool Reactor::runTasks(int64_t turn_start) {
+    int max_tasks = m_max_tasks_per_turn.load(std::memory_order_relaxed);
+
+    m_queue_depth.record(m_running_tasks.size() + m_pending_tasks.size());
+
+    /* 上一轮留下的 task 排在前面, 再从队列中取, 这一轮 task 中新投递的 task 留到下一轮 */
+    TaskNode *node = nullptr;
+    while((max_tasks <= 0 || (int)m_running_tasks.size() < max_tasks)
+        && (node = m_pending_tasks.pop()) != nullptr) {
+        m_running_tasks.push_back(node);
+    }
+    bool capped = max_tasks > 0 && (int)m_running_tasks.size() >= max_tasks;
+
+    size_t done = 0;
+    bool time_slice_hit = false;
+    while(done < m_running_tasks.size()) {
+        /* 每轮至少执行一个 task, 保证时间片很小时也能推进 */
+        if(done > 0 && isTimeSliceExhausted(turn_start)) {
+            time_slice_hit = true;
+            break;
+        }
+        if(m_running_tasks[done]->m_task) runCallback(m_running_tasks[done]->m_task);
+        delete m_running_tasks[done];
+        done++;
+    }
+    m_running_tasks.erase(m_running_tasks.begin(), m_running_tasks.begin() + done);
+
+    bool has_more = !m_running_tasks.empty();
+    if(time_slice_hit) {
+        addCounter(m_time_slice_hits, 1);
+    } else if(capped && !m_pending_tasks.empty()) {
+        addCounter(m_task_budget_hits, 1);
+        has_more = true;
+    }
+
+    addCounter(m_tasks_run, done);
+    m_last_turn_tasks.store((int)done, std::memory_order_relaxed);
+    m_carried_tasks.store((int)m_running_tasks.size(), std::memory_order_relaxed);
+    return has_more;
+}
+
+void Reactor::runExpiredTimers() {
+    if(m_timer == nullptr) {
+        return ;
+    }
+    /* 其他线程提交的定时器操作, 加入的事件可能需要重新设置 timerfd */
+    m_timer->applyCommands();
+    if(m_timer->getMode() != LoopDrivenMode || m_timer->getNextTimeoutNs() != 0) {
+        return ;
+    }
+    runCallback(m_timer->getCallBack(READ));
+}
+
+int64_t Reactor::getWaitTimeoutNs(bool has_more) {
+    if(has_more) {
+        return 0;
+    }
+
+    int64_t timeout_ns = (int64_t)t_max_epoll_timeout * 1000000;
+    if(m_timer != nullptr && m_timer->getMode() == LoopDrivenMode) {
+        int64_t timer_ns = m_timer->getNextTimeoutNs();
+        if(timer_ns >= 0 && timer_ns < timeout_ns) {
+            timeout_ns = timer_ns;
+        }
+    }
+    return timeout_ns;
+}
+
+int Reactor::waitEvents(int64_t timeout_ns) {
+    int max_spin = m_max_spin_us.load(std::memory_order_relaxed);
+    if(max_spin > 0 && timeout_ns != 0) {
+        int rt = spinWaitEvents();
+        if(rt != 0 || hasPendingWork()) {
+            return rt;
+        }
+    }
+
+    int rt = m_poller->waitNs(&m_events[0], (int)m_events.size(), timeout_ns);
+
+    /* 预算已经降到 0, 阻塞等到了事件说明又有流量了, 重新开始自旋 */
+    if(max_spin > 0 && rt > 0 && m_spin_budget_us.load(std::memory_order_relaxed) == 0) {
+        m_spin_budget_us.store(std::min(MIN_SPIN_US, max_spin), std::memory_order_relaxed);
+    }
+    return rt;
+}
+
+int Reactor::spinWaitEvents() {
+    int budget = m_spin_budget_us.load(std::memory_order_relaxed);
+    int max_spin = m_max_spin_us.load(std::memory_order_relaxed);
+    if(budget <= 0) {
+        return 0;
+    }
+
+    /* 自旋期间 loop 线程是醒着的, 让生产者跳过 eventfd 的写 */
+    m_wakeup_pending.exchange(true);
+
+    int rt = 0;
+    int64_t deadline = getMonotonicUs() + budget;
+    while(true) {
+        rt = m_poller->wait(&m_events[0], (int)m_events.size(), 0);
+        if(rt != 0 || hasPendingWork()) {
+            break;
+        }
+        if(getMonotonicUs() >= deadline) {
+            break;
+        }
+    }
+
+    /* 阻塞之前清掉标记, 再检查一次, 避免丢掉自旋期间被合并的唤醒 */
+    m_wakeup_pending.exchange(false);
+
+    if(rt != 0 || hasPendingWork()) {
+        m_busy_poll_hits.fetch_add(1, std::memory_order_relaxed);
+        m_spin_budget_us.store(std::min(budget * 2, max_spin), std::memory_order_relaxed);
+    } else {
+        m_busy_poll_misses.fetch_add(1, std::memory_order_relaxed);
+        m_spin_budget_us.store(budget / 2, std::memory_order_relaxed);
+    }
+    return rt;
+}
+
+void Reactor::adjustEventBatch(int ready) {
+    int size = (int)m_events.size();
+
+    /* 数组被填满, 说明还有就绪事件没取出来, 翻倍 */
+    if(ready == size && size < m_max_events) {
+        size = std::min(size * 2, m_max_events);
+        m_events.resize(size);
+        m_event_capacity.store(size, std::memory_order_relaxed);
+        m_sparse_turns = 0;
+        LOG_DEBUG << "Thread [" << m_tid << "], grow epoll event batch to " << size;
+        return ;
+    }
+
+    if(ready < size / 4 && size > m_min_events) {
+        if(++m_sparse_turns >= SHRINK_AFTER_TURNS) {
+            size = std::max(size / 2, m_min_events);
+            m_events.resize(size);
+            m_events.shrink_to_fit();
+            m_event_capacity.store(size, std::memory_order_relaxed);
+            m_sparse_turns = 0;
+            LOG_DEBUG << "Thread [" << m_tid << "], shrink epoll event batch to " << size;
+        }
+    } else {
+        m_sparse_turns = 0;
+    }
+}
+
 void Reactor::addWakeupFd() {
     int op = EPOLL_CTL_ADD;
     epoll_event event;
     event.data.fd = m_wake_fd;
     event.events = EPOLLIN;
 
-    if(::epoll_ctl(m_epfd, op, m_wake_fd, &event) != 0) {
+    addCounter(m_ctl_calls, 1);
+    if(m_poller->ctl(op, m_wake_fd, &event) != 0) {
         LOG_ERROR << "Thread [" << m_tid << "], epoo_ctl error, fd[" << m_wake_fd << "], errno = " << errno << ", err = " << strerror(errno);
     }
 
-    m_fds.push_back(m_wake_fd);
+    setFdEvents(m_wake_fd, event.events);
 }
 
 bool Reactor::isInLoopThread() const {
     return m_tid == gettid();
 }
 
+int64_t Reactor::getFdEvents(int fd) const {
+    if(fd < 0 || fd >= (int)m_fd_events.size()) {
+        return -1;
+    }
+    return m_fd_events[fd];
+}
+
+void Reactor::setFdEvents(int fd, int64_t events) {
+    if(fd >= (int)m_fd_events.size()) {
+        size_t size = std::max((size_t)fd + 1, m_fd_events.size() * 2);
+        m_fd_events.resize(size, -1);
+    }
+
+    if(m_fd_events[fd] == -1 && events != -1) {
+        m_fd_size++;
+    } else if(m_fd_events[fd] != -1 && events == -1) {
+        m_fd_size--;
+    }
+    m_fd_events[fd] = events;
+}
+
 void Reactor::addEventInLoopThread(int fd, epoll_event event) {
     assert(isInLoopThread());
 
-    int op = EPOLL_CTL_ADD;
-    int isExist = false;
+    int64_t cur_events = getFdEvents(fd);
+    if(cur_events == (int64_t)event.events) {
+        LOG_DEBUG << "Thread [" << m_tid << "], fd[" << fd << "] events not change, skip epoll_ctl";
+        return ;
+    }
+    /* 没有注册过, 也不关心任何事件, 不需要注册 */
+    if(cur_events == -1 && event.events == 0) {
+        return ;
+    }
 
-    auto it = std::find(m_fds.begin(), m_fds.end(), fd);
-    if(it != m_fds.end()) {
-        isExist = true;
+    int op = (cur_events == -1) ? EPOLL_CTL_ADD : EPOLL_CTL_MOD;
+    addCounter(m_ctl_calls, 1);
+    int rt = m_poller->ctl(op, fd, &event);
+
+    /* fd 被 close 后内核会自动把它从 epoll 中移除, 这里的记录可能已经过期 */
+    if(rt != 0 && op == EPOLL_CTL_MOD && errno == ENOENT) {
+        op = EPOLL_CTL_ADD;
+        addCounter(m_ctl_calls, 1);
+        rt = m_poller->ctl(op, fd, &event);
+    } else if(rt != 0 && op == EPOLL_CTL_ADD && errno == EEXIST) {
         op = EPOLL_CTL_MOD;
+        addCounter(m_ctl_calls, 1);
+        rt = m_poller->ctl(op, fd, &event);
     }
 
-    if(::epoll_ctl(m_epfd, op, fd, &event) != 0) {
+    if(rt != 0) {
         LOG_ERROR << "Thread [" << m_tid << "], epoll_ctl [" << op << "] error, fd[" 
                   << fd << "], errno = " << errno << ", sys errinfo = " << strerror(errno);
         return ;
     }
 
-    if(!isExist) {
-        m_fds.push_back(fd);
-    }
+    setFdEvents(fd, event.events);
 
     LOG_DEBUG << "Thread [" << m_tid << "], epoll_ctl add succ, fd[" << fd << "]"; 
 }
@@ -344,47 +839,19 @@ void Reactor::delEventInLoopThread(int fd) {
     assert(isInLoopThread());
 
     int op = EPOLL_CTL_DEL;
-    auto it = std::find(m_fds.begin(), m_fds.end(), fd);
-    if(it == m_fds.end()) {
+    if(getFdEvents(fd) == -1) {
         LOG_ERROR << "Thread [" << m_tid << "], fd[" << fd << "] not in this loop";
         return ;
     }
 
-    if(::epoll_ctl(m_epfd, op, fd, nullptr) != 0) {
+    addCounter(m_ctl_calls, 1);
+    if(m_poller->ctl(op, fd, nullptr) != 0) {
         LOG_ERROR << "Thread ["<< m_tid<< "], epoo_ctl error, fd[" << fd << "], sys errinfo = " << strerror(errno);
     }
 
-    m_fds.erase(it);
+    setFdEvents(fd, -1);
 
     LOG_DEBUG << "Thread ["<< m_tid<< "], del succ, fd[" << fd << "]"; 
 }
 
-
-CoroutineTaskQueue *CoroutineTaskQueue::GetCoroutineTaskQueue() {
-    if(t_coroutine_task_queue == nullptr) {
-        t_coroutine_task_queue = new CoroutineTaskQueue();
-    }
-    return t_coroutine_task_queue;
-}
-
-void CoroutineTaskQueue::push(FdEvent *fd) {
-    Mutex::Lock lock(m_mutex);
-    m_task.push(fd);
-    lock.unlock();
-}
-
-FdEvent *CoroutineTaskQueue::pop() {
-    FdEvent *it = nullptr;
-
-    Mutex::Lock lock(m_mutex);
-    if(!m_task.empty()) {
-        it = m_task.front();
-        m_task.pop();
-    }
-    lock.unlock();
-
-    return it;
-}
-
-
 }   // namespace util
\ No newline at end of file
@@ -2,7 +2,7 @@
 #define _REACTOR_H
 
 #include <map>
-#include <queue>
+#include <deque>
 #include <atomic>
 #include <vector>
 #include <functional>
@@ -13,6 +13,9 @@
 #include "fdEvent.h"
 #include "coroutine.h"
 #include "timer.h"
+#include "mpscQueue.h"
+#include "poller.h"
+#include "reactorStats.h"
 
 namespace util {
 
@@ -21,11 +24,46 @@ enum ReactorType {
     SubReactor = 2
 };
 
+/* loop 线程的心跳, 可以在任意线程通过 Reactor::getHeartbeat() 获取 */
+struct ReactorHeartbeat {
+    ReactorHeartbeat()
+        : tid(0),
+          busy_since_us(0),
+          loop_count(0),
+          coroutine_id(-1),
+          callback(nullptr) {}
+
+    pid_t tid;
+    int64_t busy_since_us;      // 这一轮开始处理的时间 (CLOCK_MONOTONIC), 0 表示正在等待事件
+    uint64_t loop_count;
+    int coroutine_id;           // 正在执行的协程 id, -1 表示没有
+    const char *callback;       // 正在执行的回调的类型名, 没有时为 nullptr
+};
+
+class Reactor;
+
+/*
+ * 挂到 Reactor 上的消息通道 (见 MailboxGrid), 以下接口都在 reactor 的 loop 线程中调用:
+ * 每轮执行 task 之前 drain 处理发给这个 reactor 的消息, 返回处理的条数
+ * 阻塞之前 flush 发布这个 reactor 这一轮发出的消息, 返回 true 表示还有消息没发出去
+ * 自旋等待时用 hasPending 检查有没有发给这个 reactor 的消息
+ */
+class ReactorMailbox {
+public:
+    virtual ~ReactorMailbox() {}
+
+    virtual int drain(Reactor *reactor) = 0;
+    virtual bool flush(Reactor *reactor) = 0;
+    virtual bool hasPending(Reactor *reactor) = 0;
+};
+
 class Reactor {
 public:
     std::shared_ptr<Reactor> ptr;
 
-    explicit Reactor();
+    Reactor();
+    /* io_uring 初始化失败时会退回 epoll */
+    explicit Reactor(ReactorBackend backend);
     ~Reactor();
 
     void addEvent(int fd, epoll_event event, bool is_wakeup = true);
@@ -42,18 +80,103 @@ public:
     Timer *getTimer();
     pid_t getTid();
 
+    /* 需要在第一次 getTimer() 之前设置, 默认使用 SetDefaultTimerMode() 的值 */
+    void setTimerMode(TimerMode mode);
+    TimerMode getTimerMode() const;
+
+    /* 同上, 默认使用 SetDefaultTimerEngine() 的值 */
+    void setTimerEngine(TimerEngine engine);
+    TimerEngine getTimerEngine() const;
+
     void setReactorType(ReactorType type);
 
+    /* epoll_event 数组从 init_size 开始, 被填满时翻倍, 直到 max_size; 需要在 loop() 之前设置 */
+    void setEventBatchSize(int init_size, int max_size);
+    ReactorStats getStats() const;
+
+    /*
+     * 忙轮询模式: 阻塞在 epoll_wait 之前, 先用 epoll_wait(..., 0) 和 task 队列自旋最多 max_spin_us 微秒
+     * 最近自旋等到了事件就加大预算, 空转就减小预算, 预算为 0 时和普通模式一样直接阻塞
+     * sock_busy_poll_us > 0 时, 分配到这个 reactor 的连接会设置 SO_BUSY_POLL
+     */
+    void setBusyPoll(int max_spin_us, int sock_busy_poll_us = 0);
+    int getSockBusyPoll() const;
+
+    /*
+     * 每轮 loop 的工作预算, 0 表示不限制 (默认):
+     * max_tasks 每轮最多执行的 task 数, max_resumes 每轮最多从就绪队列恢复的协程数,
+     * time_slice_us 每轮执行 task 和协程的最长时间, 每轮至少执行一个 task
+     * 超出预算的工作留到下一轮, 这一轮的 epoll_wait 不阻塞, 保证 IO 事件和定时器能及时处理
+     */
+    void setLoopBudget(int max_tasks, int max_resumes, int time_slice_us = 0);
+
+    /* 需要在 loop() 之前, 或者在 loop 线程中调用 */
+    void addMailbox(ReactorMailbox *mailbox);
+    void delMailbox(ReactorMailbox *mailbox);
+
+    /* 恢复协程, 执行前把协程 id / 回调类型名记到心跳中; 只能在 loop 线程中调用 */
+    void resumeCoroutine(Coroutine *cor);
+
+    ReactorBackend getBackend() const;
+
+    ReactorHeartbeat getHeartbeat() const;
+
     static Reactor *GetReactor();
+    /* 和 GetReactor() 不同, 当前线程没有 Reactor 时返回 nullptr, 不会创建 */
+    static Reactor *GetCurrentReactor();
+
+    /* 所有 Reactor 的 getStats().toString() 拼在一起 */
+    static std::string DumpAllStats();
+
+    /* 遍历当前进程中所有的 Reactor, 遍历期间持有全局锁, Reactor 不会被析构 */
+    static void ForEachReactor(std::function<void(Reactor *)> cb);
+
+    /* 默认构造的 Reactor (包括 GetReactor() 和 IOThread 中创建的) 使用的后端, 需要在创建 Reactor 之前设置 */
+    static void SetDefaultBackend(ReactorBackend backend);
+
+    /* 之后创建的 Reactor 的定时器模式, 默认 TimerFdMode */
+    static void SetDefaultTimerMode(TimerMode mode);
+
+    /* 之后创建的 Reactor 的定时器引擎, 默认 HeapEngine */
+    static void SetDefaultTimerEngine(TimerEngine engine);
 
 private:
+    struct TaskNode : public MpscNode {
+        std::function<void()> m_task;
+    };
+
     void addWakeupFd();
     bool isInLoopThread() const;
 
     void addEventInLoopThread(int fd, epoll_event event);
     void delEventInLoopThread(int fd);
 
-    int m_epfd;
+    void adjustEventBatch(int ready);
+
+    /* 返回 true 表示还有超出预算的工作留到下一轮 */
+    bool resumeReadyCoroutines(int64_t turn_start);
+    bool runTasks(int64_t turn_start);
+    bool isTimeSliceExhausted(int64_t turn_start);
+
+    void drainMailboxes();
+    bool flushMailboxes();
+    bool hasPendingWork();
+
+    /* 执行前把回调类型名记到心跳中, 卡住时 watchdog 可以报告是谁 */
+    void runCallback(const std::function<void()> &cb);
+
+    /* LoopDrivenMode 下执行已经到期的定时器事件 */
+    void runExpiredTimers();
+
+    /* 阻塞等待的超时: 有剩余工作时为 0, 否则取最近的定时器和 t_max_epoll_timeout 中较小的 */
+    int64_t getWaitTimeoutNs(bool has_more);
+    int waitEvents(int64_t timeout_ns);
+    int spinWaitEvents();
+
+    int64_t getFdEvents(int fd) const;
+    void setFdEvents(int fd, int64_t events);
+
+    Poller *m_poller;
     int m_wake_fd;
     int m_timer_fd;
     bool m_stop_flag;
@@ -61,29 +184,75 @@ private:
     bool is_init_timer;
 
     pid_t m_tid;
-    Mutex m_mutex;
 
-    std::vector<int> m_fds;
+    /* 以 fd 为下标, 记录当前注册到 epoll 的事件掩码, -1 表示没有注册 */
+    std::vector<int64_t> m_fd_events;
     std::atomic_int m_fd_size;
 
-    std::map<int, epoll_event> m_pending_add_fds;   // <fd, epoll_event>
-    std::vector<int> m_pending_del_fds;
-    std::vector<std::function<void()>> m_pending_tasks;
+    /* 其他线程投递的 task / addEvent / delEvent 都进入这个无锁队列, 由 loop 线程取出执行 */
+    MpscQueue<TaskNode> m_pending_tasks;
+    /* 这一轮取出的 task, 超出预算没有执行的留到下一轮最先执行 */
+    std::vector<TaskNode *> m_running_tasks;
+
+    /* IO 就绪的协程, 只在 loop 线程中读写, 在下一轮开头恢复 */
+    std::deque<Coroutine *> m_ready_coroutines;
+
+    std::vector<ReactorMailbox *> m_mailboxes;
+
+    std::atomic_int m_max_tasks_per_turn;
+    std::atomic_int m_max_resumes_per_turn;
+    std::atomic_int m_time_slice_us;
 
     Timer *m_timer;
+    TimerMode m_timer_mode;
+    TimerEngine m_timer_engine;
     ReactorType m_reactor_type;    
-};
 
-class CoroutineTaskQueue {
-public:
-    static CoroutineTaskQueue *GetCoroutineTaskQueue();
+    std::vector<epoll_event> m_events;
+    int m_min_events;
+    int m_max_events;
+    int m_sparse_turns;         // 连续多少轮就绪数不足数组的 1/4
 
-    void push(FdEvent *fd);
-    FdEvent *pop();
+    /* 只有 loop 线程写, 其他线程通过 getStats() 读 */
+    std::atomic<uint64_t> m_loop_count;
+    std::atomic<uint64_t> m_ready_events;
+    std::atomic_int m_last_ready;
+    std::atomic_int m_max_ready;
+    std::atomic_int m_event_capacity;
 
-private:
-    std::queue<FdEvent *> m_task;
-    Mutex m_mutex;
+    /* 已经写过 eventfd 但 loop 还没有处理, 这期间的 wakeup() 不再重复写 */
+    std::atomic_bool m_wakeup_pending;
+    std::atomic<uint64_t> m_wakeup_writes;
+    std::atomic<uint64_t> m_suppressed_wakeups;
+
+    std::atomic_int m_max_spin_us;
+    std::atomic_int m_sock_busy_poll_us;
+    std::atomic_int m_spin_budget_us;
+    std::atomic<uint64_t> m_busy_poll_hits;
+    std::atomic<uint64_t> m_busy_poll_misses;
+
+    std::atomic<uint64_t> m_tasks_run;
+    std::atomic<uint64_t> m_coroutine_resumes;
+    std::atomic<uint64_t> m_task_budget_hits;
+    std::atomic<uint64_t> m_resume_budget_hits;
+    std::atomic<uint64_t> m_time_slice_hits;
+    std::atomic_int m_last_turn_tasks;
+    std::atomic_int m_carried_tasks;
+
+    std::atomic<uint64_t> m_wakeups_received;
+    std::atomic<uint64_t> m_ctl_calls;
+    std::atomic<uint64_t> m_mailbox_messages;
+    int m_turn_resumes;             // 只有 loop 线程读写
+
+    LogHistogram m_poll_wait_us;
+    LogHistogram m_work_us;
+    LogHistogram m_ready_per_turn;
+    LogHistogram m_queue_depth;
+    LogHistogram m_resumes_per_turn;
+
+    std::atomic<int64_t> m_busy_since_us;
+    std::atomic_int m_running_cor_id;
+    std::atomic<const char *> m_running_callback;
 };
 
 }   // namespace util
@@ -0,0 +1,103 @@
+#include "poller.h"
+#include "reactorStats.h"
+
+#include <string.h>
+#include <sstream>
+
+namespace util {
+
+static int bucketIndex(uint64_t value) {
+    if(value == 0) {
+        return 0;
+    }
+    int index = 64 - __builtin_clzll(value);
+    return index < HistogramSnapshot::BUCKETS ? index : HistogramSnapshot::BUCKETS - 1;
+}
+
+HistogramSnapshot::HistogramSnapshot() : count(0), sum(0), max(0) {
+    ::memset(buckets, 0, sizeof(buckets));
+}
+
+uint64_t HistogramSnapshot::percentile(double p) const {
+    if(count == 0) {
+        return 0;
+    }
+
+    uint64_t target = (uint64_t)(count * p / 100);
+    if(target == 0) {
+        target = 1;
+    }
+
+    uint64_t seen = 0;
+    for(int i = 0; i < BUCKETS; i++) {
+        seen += buckets[i];
+        if(seen >= target) {
+            uint64_t upper = (i == 0) ? 0 : (i >= 63 ? UINT64_MAX : (1ULL << i) - 1);
+            return upper < max ? upper : max;
+        }
+    }
+    return max;
+}
+
+double HistogramSnapshot::mean() const {
+    return count == 0 ? 0 : (double)sum / count;
+}
+
+
+LogHistogram::LogHistogram() : m_count(0), m_sum(0), m_max(0) {
+    for(int i = 0; i < HistogramSnapshot::BUCKETS; i++) {
+        m_buckets[i].store(0, std::memory_order_relaxed);
+    }
+}
+
+void LogHistogram::record(uint64_t value) {
+    add(m_buckets[bucketIndex(value)], 1);
+    add(m_count, 1);
+    add(m_sum, value);
+    if(value > m_max.load(std::memory_order_relaxed)) {
+        m_max.store(value, std::memory_order_relaxed);
+    }
+}
+
+HistogramSnapshot LogHistogram::snapshot() const {
+    /* 各个计数器分别读取, 和写线程之间可能差一两个样本, 只用于观察 */
+    HistogramSnapshot snapshot;
+    for(int i = 0; i < HistogramSnapshot::BUCKETS; i++) {
+        snapshot.buckets[i] = m_buckets[i].load(std::memory_order_relaxed);
+    }
+    snapshot.count = m_count.load(std::memory_order_relaxed);
+    snapshot.sum = m_sum.load(std::memory_order_relaxed);
+    snapshot.max = m_max.load(std::memory_order_relaxed);
+    return snapshot;
+}
+
+
+static void appendHistogram(std::stringstream &ss, const char *name, const HistogramSnapshot &histogram) {
+    ss << "  " << name << ": count=" << histogram.count << ", mean=" << histogram.mean()
+       << ", p50<=" << histogram.percentile(50) << ", p99<=" << histogram.percentile(99)
+       << ", max=" << histogram.max << "\n";
+}
+
+std::string ReactorStats::toString() const {
+    std::stringstream ss;
+    ss << "reactor [tid:" << tid << "], backend=" << (backend == IoUringBackend ? "io_uring" : "epoll")
+       << ", loops=" << loop_count << ", ready_events=" << ready_events << ", max_ready=" << max_ready
+       << ", event_capacity=" << event_capacity << "\n";
+    ss << "  tasks_run=" << tasks_run << ", coroutine_resumes=" << coroutine_resumes
+       << ", carried_tasks=" << carried_tasks << ", task_budget_hits=" << task_budget_hits
+       << ", resume_budget_hits=" << resume_budget_hits << ", time_slice_hits=" << time_slice_hits << "\n";
+    ss << "  wakeups_received=" << wakeups_received << ", wakeup_writes=" << wakeup_writes
+       << ", suppressed_wakeups=" << suppressed_wakeups << ", poller_syscalls=" << poller_syscalls
+       << ", poller_ctl_calls=" << poller_ctl_calls << ", busy_poll_hits=" << busy_poll_hits
+       << ", busy_poll_misses=" << busy_poll_misses << "\n";
+    ss << "  mailbox_messages=" << mailbox_messages << "\n";
+
+    appendHistogram(ss, "poll_wait_us", poll_wait_us);
+    appendHistogram(ss, "work_us", work_us);
+    appendHistogram(ss, "ready_per_turn", ready_per_turn);
+    appendHistogram(ss, "queue_depth", queue_depth);
+    appendHistogram(ss, "resumes_per_turn", resumes_per_turn);
+    return ss.str();
+}
+
+}   // namespace util
@@ -0,0 +1,117 @@
+#ifndef _REACTORSTATS_H
+#define _REACTORSTATS_H
+
+#include <atomic>
+#include <string>
+#include <stdint.h>
+#include <sys/types.h>
+
+namespace util {
+
+/* 直方图快照, 第 0 个桶记录 0, 第 i 个桶记录 [2^(i-1), 2^i) */
+struct HistogramSnapshot {
+    static const int BUCKETS = 32;
+
+    HistogramSnapshot();
+
+    /* 返回第 p (0 ~ 100) 百分位所在桶的上界, 不超过 max */
+    uint64_t percentile(double p) const;
+    double mean() const;
+
+    uint64_t buckets[BUCKETS];
+    uint64_t count;
+    uint64_t sum;
+    uint64_t max;
+};
+
+/*
+ * 以 2 为底对数分桶的直方图, 只允许一个线程 (reactor 的 loop 线程) 写
+ * 写入只有 relaxed 的 load/store, 没有锁和原子的读-改-写, 任意线程可以随时取快照
+ */
+class LogHistogram {
+public:
+    LogHistogram();
+
+    void record(uint64_t value);
+    HistogramSnapshot snapshot() const;
+
+private:
+    static void add(std::atomic<uint64_t> &counter, uint64_t value) {
+        counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+    }
+
+    std::atomic<uint64_t> m_buckets[HistogramSnapshot::BUCKETS];
+    std::atomic<uint64_t> m_count;
+    std::atomic<uint64_t> m_sum;
+    std::atomic<uint64_t> m_max;
+};
+
+/* Reactor 运行状态的快照, 可以在任意线程通过 Reactor::getStats() 获取 */
+struct ReactorStats {
+    ReactorStats()
+        : loop_count(0),
+          ready_events(0),
+          last_ready(0),
+          max_ready(0),
+          event_capacity(0),
+          wakeup_writes(0),
+          suppressed_wakeups(0),
+          busy_poll_hits(0),
+          busy_poll_misses(0),
+          spin_budget_us(0),
+          poller_syscalls(0),
+          tasks_run(0),
+          coroutine_resumes(0),
+          task_budget_hits(0),
+          resume_budget_hits(0),
+          time_slice_hits(0),
+          last_turn_tasks(0),
+          carried_tasks(0),
+          tid(0),
+          backend(0),
+          wakeups_received(0),
+          poller_ctl_calls(0),
+          mailbox_messages(0) {}
+
+    uint64_t loop_count;        // loop 的轮数
+    uint64_t ready_events;      // 累计就绪事件数
+    int last_ready;             // 最近一轮 epoll_wait 返回的就绪数
+    int max_ready;              // 单轮 epoll_wait 返回的最大就绪数
+    int event_capacity;         // 当前 epoll_event 数组的大小
+
+    uint64_t wakeup_writes;         // 实际写 eventfd 的次数
+    uint64_t suppressed_wakeups;    // 已有唤醒未处理, 被合并掉的次数
+
+    uint64_t busy_poll_hits;        // 自旋期间等到了事件或 task
+    uint64_t busy_poll_misses;      // 自旋超时, 退回阻塞 epoll_wait
+    int spin_budget_us;             // 当前的自旋预算
+
+    uint64_t poller_syscalls;       // 后端发起的系统调用次数 (epoll_ctl / epoll_wait / io_uring_enter)
+
+    uint64_t tasks_run;             // 累计执行的 task 数
+    uint64_t coroutine_resumes;     // 累计恢复的协程数
+    uint64_t task_budget_hits;      // 因为 max_tasks 留下 task 的轮数
+    uint64_t resume_budget_hits;    // 因为 max_resumes 留下协程的轮数
+    uint64_t time_slice_hits;       // 因为时间片用完提前结束的轮数
+    int last_turn_tasks;            // 最近一轮执行的 task 数
+    int carried_tasks;              // 最近一轮结束时留到下一轮的 task 数
+
+    pid_t tid;
+    int backend;                    // ReactorBackend
+    uint64_t wakeups_received;      // loop 线程读到 eventfd 的次数
+    uint64_t poller_ctl_calls;      // epoll_ctl (或 io_uring 上等价的注册) 次数
+
+    uint64_t mailbox_messages;      // 从 MailboxGrid 收到的消息数
+
+    HistogramSnapshot poll_wait_us;     // 每轮阻塞在 epoll_wait 中的时间
+    HistogramSnapshot work_us;          // 每轮处理就绪事件、协程和 task 的时间
+    HistogramSnapshot ready_per_turn;   // 每轮 epoll_wait 返回的就绪数
+    HistogramSnapshot queue_depth;      // 每轮开始时 task 队列的长度
+    HistogramSnapshot resumes_per_turn; // 每轮恢复的协程数
+
+    std::string toString() const;
+};
+
+}   // namespace util
+
+#endif
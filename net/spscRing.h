@@ -0,0 +1,103 @@
+#ifndef _SPSCRING_H
+#define _SPSCRING_H
+
+#include <atomic>
+#include <vector>
+#include <utility>
+#include <stddef.h>
+
+namespace util {
+
+/*
+ * 有界 单生产者/单消费者 无锁环形队列, 元素按值存放
+ * 生产者 push 只写本地的尾指针, publish 时才一次性对消费者可见, 一批消息只有一次 release store
+ * 消费者 consume 一次取出所有已发布的消息, 处理完再一次性归还空间
+ * 双方各自缓存对方的指针, 只有看起来满 / 空时才去读对方的 cache line
+ */
+template <class T>
+class SpscRing {
+public:
+    /* capacity 必须是 2 的幂 */
+    explicit SpscRing(size_t capacity = 1024)
+        : m_head(0),
+          m_cached_tail(0),
+          m_tail(0),
+          m_local_tail(0),
+          m_cached_head(0),
+          m_mask(capacity - 1),
+          m_items(capacity) {}
+
+    /* 生产者线程调用, 满了返回 false */
+    bool push(T &&item) {
+        if(m_local_tail - m_cached_head > m_mask) {
+            m_cached_head = m_head.load(std::memory_order_acquire);
+            if(m_local_tail - m_cached_head > m_mask) {
+                return false;
+            }
+        }
+
+        m_items[m_local_tail & m_mask] = std::move(item);
+        m_local_tail++;
+        return true;
+    }
+
+    /* 生产者线程调用, 返回 true 表示有新消息发布出去 */
+    bool publish() {
+        if(m_tail.load(std::memory_order_relaxed) == m_local_tail) {
+            return false;
+        }
+        m_tail.store(m_local_tail, std::memory_order_release);
+        return true;
+    }
+
+    /* 消费者线程调用, 对每条已发布的消息调用 cb, 返回处理的条数 */
+    template <class Callback>
+    size_t consume(Callback cb) {
+        size_t head = m_head.load(std::memory_order_relaxed);
+        if(head == m_cached_tail) {
+            m_cached_tail = m_tail.load(std::memory_order_acquire);
+            if(head == m_cached_tail) {
+                return 0;
+            }
+        }
+
+        size_t count = 0;
+        while(head != m_cached_tail) {
+            /* 移出来再处理, 槽位里不留下消息持有的资源 */
+            T item = std::move(m_items[head & m_mask]);
+            head++;
+            count++;
+            cb(item);
+        }
+
+        m_head.store(head, std::memory_order_release);
+        return count;
+    }
+
+    /* 任意线程调用, 是否有已发布但还没有被消费的消息 */
+    bool empty() const {
+        return m_head.load(std::memory_order_acquire) == m_tail.load(std::memory_order_acquire);
+    }
+
+private:
+    SpscRing(const SpscRing &) = delete;
+    SpscRing &operator=(const SpscRing &) = delete;
+
+    /* 消费者 */
+    std::atomic<size_t> m_head;
+    size_t m_cached_tail;
+    char m_pad1[64 - sizeof(std::atomic<size_t>) - sizeof(size_t)];     // 生产者和消费者不共享 cache line
+
+    /* 生产者 */
+    std::atomic<size_t> m_tail;
+    size_t m_local_tail;
+    size_t m_cached_head;
+    char m_pad2[64 - sizeof(std::atomic<size_t>) - 2 * sizeof(size_t)];
+
+    size_t m_mask;
+    std::vector<T> m_items;
+};
+
+}   // namespace util
+
+#endif
@@ -0,0 +1,346 @@
+#include "log.h"
+#include "uringPoller.h"
+
+#include <algorithm>
+#include <errno.h>
+#include <signal.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/time_types.h>
+
+namespace util {
+
+/* user_data 的低 32 位是 fd, 高 32 位是 FdState::gen; fd 为 -1 的是内部请求 (POLL_REMOVE) */
+static const uint64_t INTERNAL_USER_DATA = 0xffffffffULL;
+
+static const uint32_t POLL_MASK = EPOLLIN | EPOLLOUT | EPOLLPRI | EPOLLRDHUP | EPOLLERR | EPOLLHUP;
+
+static uint64_t makeUserData(int fd, uint32_t gen) {
+    return ((uint64_t)gen << 32) | (uint32_t)fd;
+}
+
+UringPoller::UringPoller()
+    : m_ring_fd(-1),
+      m_pending_submit(0),
+      m_harvest_seq(0),
+      m_sq_ptr(MAP_FAILED),
+      m_sq_size(0),
+      m_sq_local_tail(0),
+      m_sqes((io_uring_sqe *)MAP_FAILED),
+      m_sqes_size(0),
+      m_cq_ptr(MAP_FAILED),
+      m_cq_size(0) {}
+
+UringPoller::~UringPoller() {
+    if(m_sqes != MAP_FAILED) {
+        ::munmap(m_sqes, m_sqes_size);
+    }
+    if(m_cq_ptr != MAP_FAILED && m_cq_ptr != m_sq_ptr) {
+        ::munmap(m_cq_ptr, m_cq_size);
+    }
+    if(m_sq_ptr != MAP_FAILED) {
+        ::munmap(m_sq_ptr, m_sq_size);
+    }
+    if(m_ring_fd != -1) {
+        ::close(m_ring_fd);
+    }
+}
+
+bool UringPoller::init(unsigned entries /*= 1024*/) {
+    io_uring_params params;
+    ::memset(&params, 0, sizeof(params));
+
+    m_ring_fd = (int)::syscall(__NR_io_uring_setup, entries, &params);
+    if(m_ring_fd < 0) {
+        LOG_ERROR << "io_uring_setup error, sys error=" << strerror(errno);
+        m_ring_fd = -1;
+        return false;
+    }
+
+    /* wait() 的超时通过 IORING_ENTER_EXT_ARG 传入, 需要 5.11 以上的内核 */
+    if(!(params.features & IORING_FEAT_EXT_ARG)) {
+        LOG_ERROR << "io_uring does not support IORING_FEAT_EXT_ARG, features = " << params.features;
+        return false;
+    }
+
+    m_sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    m_cq_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if(single_mmap) {
+        m_sq_size = std::max(m_sq_size, m_cq_size);
+        m_cq_size = m_sq_size;
+    }
+
+    m_sq_ptr = ::mmap(nullptr, m_sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      m_ring_fd, IORING_OFF_SQ_RING);
+    if(m_sq_ptr == MAP_FAILED) {
+        LOG_ERROR << "mmap io_uring sq ring error, sys error=" << strerror(errno);
+        return false;
+    }
+
+    if(single_mmap) {
+        m_cq_ptr = m_sq_ptr;
+    } else {
+        m_cq_ptr = ::mmap(nullptr, m_cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                          m_ring_fd, IORING_OFF_CQ_RING);
+        if(m_cq_ptr == MAP_FAILED) {
+            LOG_ERROR << "mmap io_uring cq ring error, sys error=" << strerror(errno);
+            return false;
+        }
+    }
+
+    m_sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+    m_sqes = (io_uring_sqe *)::mmap(nullptr, m_sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                                    m_ring_fd, IORING_OFF_SQES);
+    if(m_sqes == MAP_FAILED) {
+        LOG_ERROR << "mmap io_uring sqes error, sys error=" << strerror(errno);
+        return false;
+    }
+
+    char *sq = (char *)m_sq_ptr;
+    m_sq_head = (unsigned *)(sq + params.sq_off.head);
+    m_sq_tail = (unsigned *)(sq + params.sq_off.tail);
+    m_sq_mask = (unsigned *)(sq + params.sq_off.ring_mask);
+    m_sq_entries = (unsigned *)(sq + params.sq_off.ring_entries);
+    m_sq_array = (unsigned *)(sq + params.sq_off.array);
+    m_sq_local_tail = *m_sq_tail;
+
+    char *cq = (char *)m_cq_ptr;
+    m_cq_head = (unsigned *)(cq + params.cq_off.head);
+    m_cq_tail = (unsigned *)(cq + params.cq_off.tail);
+    m_cq_mask = (unsigned *)(cq + params.cq_off.ring_mask);
+    m_cqes = (io_uring_cqe *)(cq + params.cq_off.cqes);
+
+    LOG_INFO << "io_uring poller init succ, ring fd = " << m_ring_fd << ", sq entries = " << params.sq_entries
+             << ", cq entries = " << params.cq_entries;
+    return true;
+}
+
+int UringPoller::ctl(int op, int fd, epoll_event *event) {
+    if(fd < 0) {
+        errno = EBADF;
+        return -1;
+    }
+
+    if(fd >= (int)m_fds.size()) {
+        m_fds.resize(std::max((size_t)fd + 1, m_fds.size() * 2));
+    }
+
+    FdState &state = m_fds[fd];
+    if(op == EPOLL_CTL_ADD) {
+        if(state.active) {
+            errno = EEXIST;
+            return -1;
+        }
+    } else if(op == EPOLL_CTL_MOD || op == EPOLL_CTL_DEL) {
+        if(!state.active) {
+            errno = ENOENT;
+            return -1;
+        }
+        removePoll(fd, state);
+    } else {
+        errno = EINVAL;
+        return -1;
+    }
+
+    state.gen++;
+    if(op == EPOLL_CTL_DEL) {
+        state.active = false;
+        return 0;
+    }
+
+    state.active = true;
+    state.events = event->events;
+    state.data = event->data.u64;
+    if(!armPoll(fd, state)) {
+        /* 没有挂上 poll 的 fd 不会再有事件, 当作没有注册, 由 reactor 打印错误 */
+        state.active = false;
+        errno = EBUSY;
+        return -1;
+    }
+    return 0;
+}
+
+int UringPoller::wait(epoll_event *events, int max_events, int timeout_ms) {
+    return waitNs(events, max_events, timeout_ms < 0 ? -1 : (int64_t)timeout_ms * 1000000);
+}
+
+int UringPoller::waitNs(epoll_event *events, int max_events, int64_t timeout_ns) {
+    rearmPending();
+    int n = harvest(events, max_events);
+
+    /* 已经有就绪事件或者不需要等待, 只把这一轮积累的 SQE 提交掉 */
+    if(n > 0 || timeout_ns == 0) {
+        if(m_pending_submit > 0) {
+            enter(m_pending_submit, 0, 0, 0);
+            if(n == 0) {
+                n = harvest(events, max_events);
+            }
+        }
+        return n;
+    }
+
+    /* 提交和等待合并成一次 io_uring_enter */
+    if(enter(m_pending_submit, 1, IORING_ENTER_GETEVENTS, timeout_ns) < 0
+        && errno != ETIME && errno != EINTR && errno != EBUSY) {
+        return -1;
+    }
+    return harvest(events, max_events);
+}
+
+io_uring_sqe *UringPoller::getSqe() {
+    unsigned head = __atomic_load_n(m_sq_head, __ATOMIC_ACQUIRE);
+    if(m_sq_local_tail - head >= *m_sq_entries) {
+        /* 提交队列满了, 先提交一次 */
+        enter(m_pending_submit, 0, 0, 0);
+        head = __atomic_load_n(m_sq_head, __ATOMIC_ACQUIRE);
+        if(m_sq_local_tail - head >= *m_sq_entries) {
+            LOG_ERROR << "io_uring submission queue is full";
+            return nullptr;
+        }
+    }
+
+    unsigned index = m_sq_local_tail & *m_sq_mask;
+    io_uring_sqe *sqe = &m_sqes[index];
+    ::memset(sqe, 0, sizeof(*sqe));
+    m_sq_array[index] = index;
+
+    m_sq_local_tail++;
+    __atomic_store_n(m_sq_tail, m_sq_local_tail, __ATOMIC_RELEASE);
+    m_pending_submit++;
+    return sqe;
+}
+
+bool UringPoller::armPoll(int fd, FdState &state) {
+    uint32_t mask = state.events & POLL_MASK;
+    if(mask == 0) {
+        /* 事件为空时不挂 poll, 等下一次 MOD */
+        return true;
+    }
+
+    io_uring_sqe *sqe = getSqe();
+    if(!sqe) {
+        return false;
+    }
+
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    sqe->poll32_events = mask;
+    sqe->len = (state.events & EPOLLET) ? IORING_POLL_ADD_MULTI : 0;
+    sqe->user_data = makeUserData(fd, state.gen);
+    state.armed = true;
+    return true;
+}
+
+void UringPoller::rearmPending() {
+    if(m_rearm_fds.empty()) {
+        return ;
+    }
+
+    std::vector<int> fds;
+    fds.swap(m_rearm_fds);
+    for(size_t i = 0; i < fds.size(); i++) {
+        FdState &state = m_fds[fds[i]];
+        /* 期间已经被 MOD / DEL 过的不需要再挂 */
+        if(state.active && !state.armed && !armPoll(fds[i], state)) {
+            m_rearm_fds.push_back(fds[i]);
+        }
+    }
+}
+
+void UringPoller::removePoll(int fd, FdState &state) {
+    if(!state.armed) {
+        return ;
+    }
+
+    io_uring_sqe *sqe = getSqe();
+    if(!sqe) {
+        return ;
+    }
+
+    sqe->opcode = IORING_OP_POLL_REMOVE;
+    sqe->fd = -1;
+    sqe->addr = makeUserData(fd, state.gen);
+    sqe->user_data = INTERNAL_USER_DATA;
+    state.armed = false;
+}
+
+int UringPoller::enter(unsigned to_submit, unsigned min_complete, unsigned flags, int64_t timeout_ns) {
+    __kernel_timespec ts;
+    io_uring_getevents_arg arg;
+    ::memset(&arg, 0, sizeof(arg));
+
+    if(timeout_ns > 0) {
+        ts.tv_sec = timeout_ns / 1000000000;
+        ts.tv_nsec = timeout_ns % 1000000000;
+        arg.ts = (uint64_t)(uintptr_t)&ts;
+    }
+    arg.sigmask_sz = _NSIG / 8;
+    flags |= IORING_ENTER_EXT_ARG;
+
+    countSyscall();
+    int rt = (int)::syscall(__NR_io_uring_enter, m_ring_fd, to_submit, min_complete, flags, &arg, sizeof(arg));
+    if(rt >= 0) {
+        m_pending_submit -= std::min((unsigned)rt, m_pending_submit);
+    } else if(errno != ETIME && errno != EINTR) {
+        LOG_ERROR << "io_uring_enter error, sys error=" << strerror(errno);
+    }
+    return rt;
+}
+
+int UringPoller::harvest(epoll_event *events, int max_events) {
+    m_harvest_seq++;
+
+    int n = 0;
+    unsigned head = *m_cq_head;
+    unsigned tail = __atomic_load_n(m_cq_tail, __ATOMIC_ACQUIRE);
+    while(head != tail) {
+        io_uring_cqe *cqe = &m_cqes[head & *m_cq_mask];
+        uint64_t user_data = cqe->user_data;
+        int fd = (int)(uint32_t)user_data;
+        uint32_t gen = (uint32_t)(user_data >> 32);
+
+        if(user_data == INTERNAL_USER_DATA || fd < 0 || fd >= (int)m_fds.size()) {
+            head++;
+            continue;
+        }
+
+        FdState &state = m_fds[fd];
+        if(!state.active || state.gen != gen) {
+            /* ctl MOD / DEL 之前挂上的 poll, 已经过期 */
+            head++;
+            continue;
+        }
+
+        uint32_t revents = cqe->res < 0 ? (uint32_t)EPOLLERR : (uint32_t)cqe->res;
+        if(state.harvest == m_harvest_seq) {
+            events[state.index].events |= revents;
+        } else {
+            if(n == max_events) {
+                break;
+            }
+            state.harvest = m_harvest_seq;
+            state.index = n;
+            events[n].events = revents;
+            events[n].data.u64 = state.data;
+            n++;
+        }
+
+        if(!(cqe->flags & IORING_CQE_F_MORE)) {
+            /* oneshot 完成或者 multishot 被内核终止, 重新挂上 */
+            state.armed = false;
+            if(!armPoll(fd, state)) {
+                /* 提交队列满了, 下一次 wait 之前再挂 */
+                m_rearm_fds.push_back(fd);
+            }
+        }
+        head++;
+    }
+
+    __atomic_store_n(m_cq_head, head, __ATOMIC_RELEASE);
+    return n;
+}
+
+}   // namespace util
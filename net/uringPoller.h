@@ -0,0 +1,93 @@
+#ifndef _URINGPOLLER_H
+#define _URINGPOLLER_H
+
+#include <vector>
+#include <stdint.h>
+#include <linux/io_uring.h>
+
+#include "poller.h"
+
+namespace util {
+
+/*
+ * 基于 io_uring 的 Poller, 直接使用 io_uring_setup / io_uring_enter, 不依赖 liburing
+ * - 普通 fd 使用 oneshot POLL_ADD, 每次完成后重新挂上, 语义等同于 epoll 的水平触发
+ * - 带 EPOLLET 的 fd 使用 multishot POLL_ADD, 只在内核结束 multishot 时重新挂上
+ * - ctl() 只把 SQE 放进提交队列, 在 wait() 中和等待合并成一次 io_uring_enter
+ */
+class UringPoller : public Poller {
+public:
+    UringPoller();
+    ~UringPoller();
+
+    bool init(unsigned entries = 1024);
+
+    ReactorBackend getBackend() const {
+        return IoUringBackend;
+    }
+
+    int ctl(int op, int fd, epoll_event *event);
+    int wait(epoll_event *events, int max_events, int timeout_ms);
+    int waitNs(epoll_event *events, int max_events, int64_t timeout_ns);
+
+private:
+    struct FdState {
+        FdState()
+            : active(false),
+              armed(false),
+              events(0),
+              gen(0),
+              data(0),
+              harvest(0),
+              index(-1) {}
+
+        bool active;        // 已经 ctl ADD
+        bool armed;         // 内核中有一个未完成的 POLL_ADD
+        uint32_t events;
+        uint32_t gen;       // 每次 ADD / MOD / DEL 加一, 用来丢弃过期的 CQE
+        uint64_t data;
+        uint64_t harvest;   // 最近一次输出到 events 数组是在哪一轮 wait
+        int index;          // 那一轮输出的下标, 同一个 fd 的多个 CQE 合并到一起
+    };
+
+    io_uring_sqe *getSqe();
+    /* 提交队列满时返回 false */
+    bool armPoll(int fd, FdState &state);
+    void rearmPending();
+    void removePoll(int fd, FdState &state);
+
+    /* timeout_ns <= 0 表示不设超时 */
+    int enter(unsigned to_submit, unsigned min_complete, unsigned flags, int64_t timeout_ns);
+    int harvest(epoll_event *events, int max_events);
+
+    int m_ring_fd;
+    unsigned m_pending_submit;
+    uint64_t m_harvest_seq;
+
+    void *m_sq_ptr;
+    size_t m_sq_size;
+    unsigned *m_sq_head;
+    unsigned *m_sq_tail;
+    unsigned *m_sq_mask;
+    unsigned *m_sq_entries;
+    unsigned *m_sq_array;
+    unsigned m_sq_local_tail;
+
+    io_uring_sqe *m_sqes;
+    size_t m_sqes_size;
+
+    void *m_cq_ptr;
+    size_t m_cq_size;
+    unsigned *m_cq_head;
+    unsigned *m_cq_tail;
+    unsigned *m_cq_mask;
+    io_uring_cqe *m_cqes;
+
+    std::vector<FdState> m_fds;
+    /* CQE 完成后没能重新挂上 poll 的 fd */
+    std::vector<int> m_rearm_fds;
+};
+
+}   // namespace util
+
+#endif
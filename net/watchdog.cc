@@ -0,0 +1,181 @@
+#include "log.h"
+#include "reactor.h"
+#include "watchdog.h"
+
+#include <time.h>
+#include <errno.h>
+#include <vector>
+#include <algorithm>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <execinfo.h>
+#include <sys/syscall.h>
+
+namespace util {
+
+static const int MAX_BACKTRACE_FRAMES = 64;
+/* 等待被卡住的线程执行完信号处理函数的最长时间 */
+static const int BACKTRACE_WAIT_MS = 100;
+
+/* 0: 空闲, 1: 已请求, 2: 正在写, 3: 已完成 */
+static std::atomic_int g_backtrace_state(0);
+static void *g_backtrace_frames[MAX_BACKTRACE_FRAMES];
+static int g_backtrace_size = 0;
+
+static void backtraceHandler(int /*signal_no*/) {
+    int expected = 1;
+    if(!g_backtrace_state.compare_exchange_strong(expected, 2)) {
+        return ;
+    }
+    g_backtrace_size = ::backtrace(g_backtrace_frames, MAX_BACKTRACE_FRAMES);
+    g_backtrace_state.store(3);
+}
+
+static int64_t getMonotonicUs() {
+    timespec ts;
+    ::clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+ReactorWatchdog *ReactorWatchdog::GetWatchdog() {
+    static ReactorWatchdog *watchdog = new ReactorWatchdog();
+    return watchdog;
+}
+
+ReactorWatchdog::ReactorWatchdog()
+    : m_is_running(false),
+      m_threshold_ms(100),
+      m_check_interval_ms(50),
+      m_stall_count(0) {}
+
+ReactorWatchdog::~ReactorWatchdog() {
+    stop();
+}
+
+void ReactorWatchdog::start(int threshold_ms /*= 100*/, int check_interval_ms /*= 0*/) {
+    if(threshold_ms <= 0 || check_interval_ms < 0) {
+        LOG_ERROR << "ReactorWatchdog::start invalid param, threshold_ms = " << threshold_ms
+                  << ", check_interval_ms = " << check_interval_ms;
+        return ;
+    }
+    if(m_is_running) {
+        LOG_ERROR << "ReactorWatchdog::start watchdog is already running";
+        return ;
+    }
+
+    m_threshold_ms = threshold_ms;
+    m_check_interval_ms = check_interval_ms > 0 ? check_interval_ms : std::max(threshold_ms / 2, 1);
+
+    /* backtrace() 第一次调用时会加载 libgcc, 先在这里调用一次, 避免在信号处理函数中分配内存 */
+    void *frames[1];
+    ::backtrace(frames, 1);
+
+    struct sigaction action;
+    ::memset(&action, 0, sizeof(action));
+    action.sa_handler = backtraceHandler;
+    action.sa_flags = SA_RESTART;
+    ::sigemptyset(&action.sa_mask);
+    if(::sigaction(SIGUSR2, &action, nullptr) != 0) {
+        LOG_ERROR << "ReactorWatchdog::start sigaction error, sys error=" << strerror(errno);
+    }
+
+    m_is_running = true;
+    ::pthread_create(&m_thread, nullptr, &ReactorWatchdog::main, this);
+    LOG_INFO << "reactor watchdog start, threshold = " << m_threshold_ms << "ms, check interval = "
+             << m_check_interval_ms << "ms";
+}
+
+void ReactorWatchdog::stop() {
+    if(!m_is_running) {
+        return ;
+    }
+
+    m_is_running = false;
+    ::pthread_join(m_thread, nullptr);
+}
+
+uint64_t ReactorWatchdog::getStallCount() const {
+    return m_stall_count.load(std::memory_order_relaxed);
+}
+
+void *ReactorWatchdog::main(void *arg) {
+    ReactorWatchdog *watchdog = static_cast<ReactorWatchdog *>(arg);
+    while(watchdog->m_is_running) {
+        ::usleep(watchdog->m_check_interval_ms * 1000);
+        watchdog->check();
+    }
+    return nullptr;
+}
+
+void ReactorWatchdog::check() {
+    int64_t now = getMonotonicUs();
+    std::vector<ReactorHeartbeat> stalls;
+
+    Reactor::ForEachReactor([&](Reactor *reactor) {
+        ReactorHeartbeat heartbeat = reactor->getHeartbeat();
+        if(heartbeat.busy_since_us == 0 || now - heartbeat.busy_since_us < m_threshold_ms * 1000) {
+            return ;
+        }
+
+        auto it = m_reported.find(heartbeat.tid);
+        if(it != m_reported.end() && it->second == heartbeat.busy_since_us) {
+            return ;
+        }
+        m_reported[heartbeat.tid] = heartbeat.busy_since_us;
+        stalls.push_back(heartbeat);
+    });
+
+    /* 抓调用栈时不持有 Reactor 的全局锁 */
+    for(size_t i = 0; i < stalls.size(); i++) {
+        ReactorHeartbeat &heartbeat = stalls[i];
+        m_stall_count.fetch_add(1, std::memory_order_relaxed);
+
+        LOG_ERROR << "reactor stall detected, thread id = " << heartbeat.tid
+                  << ", busy for " << (now - heartbeat.busy_since_us) / 1000 << "ms"
+                  << ", loop count = " << heartbeat.loop_count
+                  << ", coroutine id = " << heartbeat.coroutine_id
+                  << ", callback = " << (heartbeat.callback ? heartbeat.callback : "null");
+
+        dumpBacktrace(heartbeat.tid);
+    }
+}
+
+void ReactorWatchdog::dumpBacktrace(pid_t tid) {
+    int expected = 0;
+    if(!g_backtrace_state.compare_exchange_strong(expected, 1)) {
+        return ;
+    }
+
+    if(::syscall(SYS_tgkill, ::getpid(), tid, SIGUSR2) != 0) {
+        LOG_ERROR << "send SIGUSR2 to thread " << tid << " error, sys error=" << strerror(errno);
+        g_backtrace_state.store(0);
+        return ;
+    }
+
+    int64_t deadline = getMonotonicUs() + BACKTRACE_WAIT_MS * 1000;
+    while(g_backtrace_state.load() != 3 && getMonotonicUs() < deadline) {
+        ::usleep(1000);
+    }
+
+    /* 超时还没进入信号处理函数就撤回请求; 已经在写了就等它写完 */
+    expected = 1;
+    if(g_backtrace_state.compare_exchange_strong(expected, 0)) {
+        LOG_ERROR << "capture backtrace of thread " << tid << " timeout";
+        return ;
+    }
+    while(g_backtrace_state.load() != 3) {
+        ::usleep(1000);
+    }
+
+    char **symbols = ::backtrace_symbols(g_backtrace_frames, g_backtrace_size);
+    for(int i = 0; i < g_backtrace_size; i++) {
+        LOG_ERROR << "thread " << tid << " #" << i << " " << (symbols ? symbols[i] : "?");
+    }
+    ::free(symbols);
+
+    g_backtrace_state.store(0);
+}
+
+}   // namespace util
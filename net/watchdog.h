@@ -0,0 +1,49 @@
+#ifndef _WATCHDOG_H
+#define _WATCHDOG_H
+
+#include <map>
+#include <atomic>
+#include <pthread.h>
+#include <sys/types.h>
+
+namespace util {
+
+/*
+ * Reactor 卡顿检测: 后台线程定期检查所有 Reactor 的心跳,
+ * 某一轮 loop 超过 threshold_ms 还没有回到 epoll_wait, 就打印 reactor 的线程 id、
+ * 正在执行的协程 id 和回调类型名, 并向卡住的线程发送 SIGUSR2 抓取它当前的调用栈
+ * 同一次卡顿只报告一次
+ */
+class ReactorWatchdog {
+public:
+    static ReactorWatchdog *GetWatchdog();
+
+    /* check_interval_ms 为 0 时取 threshold_ms 的一半 */
+    void start(int threshold_ms = 100, int check_interval_ms = 0);
+    void stop();
+
+    uint64_t getStallCount() const;
+
+private:
+    ReactorWatchdog();
+    ~ReactorWatchdog();
+
+    static void *main(void *arg);
+
+    void check();
+    void dumpBacktrace(pid_t tid);
+
+    pthread_t m_thread;
+    std::atomic_bool m_is_running;
+
+    int m_threshold_ms;
+    int m_check_interval_ms;
+
+    /* tid -> 已经报告过的那一轮的开始时间 */
+    std::map<pid_t, int64_t> m_reported;
+    std::atomic<uint64_t> m_stall_count;
+};
+
+}   // namespace util
+
+#endif
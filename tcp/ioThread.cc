@@ -1,15 +1,96 @@
+#include <sched.h>
+#include <stdio.h>
+#include <errno.h>
 #include <assert.h>
+#include <string.h>
+#include <algorithm>
 
 #include "log.h"
 #include "ioThread.h"
 
 namespace util {
 
-static Reactor *t_reactor_ptr = nullptr;
-static IOThread *t_current_io_thread = nullptr;
+struct CpuTopology {
+    int cpu;
+    int package;        // 物理 CPU
+    int core;           // 物理 CPU 内的物理核
+    int sibling;        // 在同一个物理核的超线程中排第几
+    int core_rank;      // 物理核在所在物理 CPU 中排第几
+};
+
+static int readTopology(int cpu, const char *name) {
+    char path[128];
+    ::snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/%s", cpu, name);
+
+    FILE *fp = ::fopen(path, "r");
+    if(fp == nullptr) {
+        return -1;
+    }
+
+    int value = -1;
+    if(::fscanf(fp, "%d", &value) != 1) {
+        value = -1;
+    }
+    ::fclose(fp);
+    return value;
+}
+
+/* 按策略给出 CPU 的使用顺序; 读不到 sysfs 拓扑时所有 CPU 视为不同的物理核 */
+static std::vector<int> orderCpus(const std::vector<int> &cpus, CpuAffinityPolicy policy) {
+    std::vector<CpuTopology> topo;
+    for(size_t i = 0; i < cpus.size(); i++) {
+        CpuTopology item;
+        item.cpu = cpus[i];
+        item.package = readTopology(cpus[i], "physical_package_id");
+        item.core = readTopology(cpus[i], "core_id");
+        if(item.core == -1) {
+            item.core = cpus[i];
+        }
+        topo.push_back(item);
+    }
+
+    std::sort(topo.begin(), topo.end(), [](const CpuTopology &a, const CpuTopology &b) {
+        if(a.package != b.package) return a.package < b.package;
+        if(a.core != b.core) return a.core < b.core;
+        return a.cpu < b.cpu;
+    });
+
+    /* 排序后同一个物理核的超线程相邻, 同一个物理 CPU 的物理核相邻 */
+    for(size_t i = 0; i < topo.size(); i++) {
+        if(i > 0 && topo[i].package == topo[i - 1].package && topo[i].core == topo[i - 1].core) {
+            topo[i].sibling = topo[i - 1].sibling + 1;
+            topo[i].core_rank = topo[i - 1].core_rank;
+        } else if(i > 0 && topo[i].package == topo[i - 1].package) {
+            topo[i].sibling = 0;
+            topo[i].core_rank = topo[i - 1].core_rank + 1;
+        } else {
+            topo[i].sibling = 0;
+            topo[i].core_rank = 0;
+        }
+    }
+
+    if(policy == SpreadAffinity) {
+        std::stable_sort(topo.begin(), topo.end(), [](const CpuTopology &a, const CpuTopology &b) {
+            if(a.sibling != b.sibling) return a.sibling < b.sibling;
+            if(a.core_rank != b.core_rank) return a.core_rank < b.core_rank;
+            return a.package < b.package;
+        });
+    }
+
+    std::vector<int> order;
+    for(size_t i = 0; i < topo.size(); i++) {
+        order.push_back(topo[i].cpu);
+    }
+    return order;
+}
+
+static thread_local Reactor *t_reactor_ptr = nullptr;
+static thread_local IOThread *t_current_io_thread = nullptr;
 
 IOThread::IOThread()
     : m_index(-1),
+      m_cpu(-1),
+      m_connection_count(0),
       m_tid(-1),
       m_thread(-1),
       m_reactor(nullptr) {
@@ -32,8 +113,10 @@ IOThread::IOThread()
 }
 
 IOThread::~IOThread() {
-    m_reactor->stop();
-    ::pthread_join(m_thread, nullptr);
+    stop();
+
+    /* 先于 reactor 析构, 时间轮析构时要从 reactor 的定时器中删除 */
+    m_time_wheel.reset();
     
     if(m_reactor) {
         delete m_reactor;
@@ -41,6 +124,16 @@ IOThread::~IOThread() {
     }
 }
 
+void IOThread::stop() {
+    if(m_thread == (pthread_t)-1) {
+        return ;
+    }
+
+    m_reactor->stop();
+    ::pthread_join(m_thread, nullptr);
+    m_thread = (pthread_t)-1;
+}
+
 void *IOThread::main(void *arg) {
     t_reactor_ptr = new Reactor();
     assert(t_reactor_ptr != nullptr);
@@ -51,6 +144,16 @@ void *IOThread::main(void *arg) {
     iothread->m_tid = gettid();
     iothread->m_reactor = t_reactor_ptr;
     iothread->m_reactor->setReactorType(SubReactor);
+    /* 在自己的线程中创建, 时间轮的定时器直接挂到自己的 reactor 上; 100ms 一格, 一圈 102.4s */
+    iothread->m_time_wheel = std::make_shared<ConnectionTimeWheel>(t_reactor_ptr, 100, 1024, ConnectionTimeoutClassCount,
+        [](const TcpConnection::ptr &conn) {
+            conn->shutdownConnection();
+        });
+    iothread->m_time_wheel->setTimeout(FirstByteTimeout, 20 * 1000);
+    iothread->m_time_wheel->setTimeout(IdleTimeout, 100 * 1000);
+    iothread->m_time_wheel->setTimeout(RequestHeaderTimeout, 20 * 1000);
+    iothread->m_time_wheel->setTimeout(RequestBodyTimeout, 60 * 1000);
+    iothread->m_time_wheel->setTimeout(LongPollTimeout, 300 * 1000);
 
     Coroutine::GetCurrentCoroutine();
 
@@ -68,20 +171,58 @@ void *IOThread::main(void *arg) {
 }
 
 Reactor *IOThread::getReactor() {
-    return t_reactor_ptr;
+    return m_reactor;
 }
 
 IOThread *IOThread::GetCurrentThread() {
     return t_current_io_thread;
 }
 
+void IOThread::setBusyPoll(int max_spin_us, int sock_busy_poll_us /*= 0*/) {
+    m_reactor->setBusyPoll(max_spin_us, sock_busy_poll_us);
+}
+
+bool IOThread::setCpu(int cpu) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if(cpu >= 0) {
+        CPU_SET(cpu, &set);
+    } else {
+        std::vector<int> cpus = IOThreadPool::GetAvailableCpus();
+        for(size_t i = 0; i < cpus.size(); i++) {
+            CPU_SET(cpus[i], &set);
+        }
+    }
+
+    int rt = ::pthread_setaffinity_np(m_thread, sizeof(set), &set);
+    if(rt != 0) {
+        LOG_ERROR << "IOThread " << m_index << " set cpu " << cpu << " error, sys error=" << strerror(rt);
+        return false;
+    }
+
+    m_cpu = cpu;
+    LOG_DEBUG << "IOThread " << m_index << " bind to cpu " << cpu;
+    return true;
+}
+
+
+IOThreadPool::IOThreadPool(int size /*= 0*/, CpuAffinityPolicy policy /*= CompactAffinity*/,
+                           const std::vector<int> &cpus /*= std::vector<int>()*/)
+    : m_size(size),
+      m_main_cpu(-1),
+      m_index(-1) {
 
-IOThreadPool::IOThreadPool(int size) : m_size(size), m_index(-1) {
-    for(int i = 0; i < size; i++) {
+    if(m_size <= 0) {
+        m_size = std::max((int)GetAvailableCpus().size(), 1);
+    }
+
+    for(int i = 0; i < m_size; i++) {
         IOThread::ptr tmp = std::make_shared<IOThread>();
         tmp->setThreadIndex(i);
         m_io_threads.push_back(tmp);
     }
+
+    setCpuAffinity(policy, cpus);
 }
 
 void IOThreadPool::start() {
@@ -91,6 +232,12 @@ void IOThreadPool::start() {
     }
 }
 
+void IOThreadPool::stop() {
+    for(int i = 0; i < m_size; i++) {
+        m_io_threads[i]->stop();
+    }
+}
+
 IOThread *IOThreadPool::getIOThread() {
     if(m_index == -1 || m_index == m_size) {
         m_index = 0;
@@ -99,5 +246,69 @@ IOThread *IOThreadPool::getIOThread() {
     return m_io_threads[m_index++].get();
 }
 
+IOThread *IOThreadPool::getIOThread(int index) {
+    if(index < 0 || index >= m_size) {
+        LOG_ERROR << "IOThreadPool::getIOThread invalid index = " << index;
+        return nullptr;
+    }
+
+    return m_io_threads[index].get();
+}
+
+void IOThreadPool::setCpuAffinity(CpuAffinityPolicy policy, const std::vector<int> &cpus /*= std::vector<int>()*/) {
+    std::vector<int> available = GetAvailableCpus();
+    std::vector<int> order;
+
+    if(policy == ExplicitAffinity) {
+        for(size_t i = 0; i < cpus.size(); i++) {
+            if(std::find(available.begin(), available.end(), cpus[i]) == available.end()) {
+                LOG_ERROR << "IOThreadPool::setCpuAffinity cpu " << cpus[i] << " is not available, skip it";
+                continue;
+            }
+            order.push_back(cpus[i]);
+        }
+    } else if(policy != NoAffinity) {
+        order = orderCpus(available, policy);
+    }
+
+    for(int i = 0; i < m_size; i++) {
+        m_io_threads[i]->setCpu(order.empty() ? -1 : order[i % order.size()]);
+    }
+
+    /* 线程数少于 CPU 数时 main reactor 用下一个空闲的 CPU, 否则和第一个 IO 线程共用 */
+    m_main_cpu = order.empty() ? -1 : order[m_size % order.size()];
+
+    LOG_INFO << "IOThreadPool set cpu affinity, policy = " << policy << ", io thread num = " << m_size
+             << ", available cpu num = " << available.size() << ", main cpu = " << m_main_cpu;
+}
+
+std::vector<int> IOThreadPool::getCpuMap() {
+    std::vector<int> cpu_map;
+    for(int i = 0; i < m_size; i++) {
+        cpu_map.push_back(m_io_threads[i]->getCpu());
+    }
+    return cpu_map;
+}
+
+std::vector<int> IOThreadPool::GetAvailableCpus() {
+    /* main reactor 绑核之后, 调用线程的 affinity 会变, 所以只在第一次调用时读取 */
+    static std::vector<int> cpus = []() {
+        std::vector<int> result;
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        if(::sched_getaffinity(0, sizeof(set), &set) != 0) {
+            LOG_ERROR << "sched_getaffinity error, sys error=" << strerror(errno);
+            return result;
+        }
+        for(int i = 0; i < CPU_SETSIZE; i++) {
+            if(CPU_ISSET(i, &set)) {
+                result.push_back(i);
+            }
+        }
+        return result;
+    }();
+    return cpus;
+}
+
 
 }   // namespace util
\ No newline at end of file
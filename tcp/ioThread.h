@@ -15,6 +15,14 @@
 
 namespace util {
 
+/* IO 线程的绑核策略 */
+enum CpuAffinityPolicy {
+    NoAffinity = 0,         // 不绑核, 交给调度器
+    CompactAffinity = 1,    // 按 物理 CPU -> 物理核 -> 超线程 的顺序紧凑排布, 共享缓存
+    SpreadAffinity = 2,     // 先分散到不同的物理 CPU 和物理核, 物理核用完后才用超线程
+    ExplicitAffinity = 3    // 按调用方给出的 CPU 列表依次绑定
+};
+
 class IOThread {
 public:
     typedef std::shared_ptr<IOThread> ptr;
@@ -31,15 +39,35 @@ public:
     Reactor *getReactor();
     static IOThread *GetCurrentThread();
 
+    /* 停止 reactor 并等待线程退出, 之后 reactor 仍然有效, 在析构时释放 */
+    void stop();
+
+    /* 这个 IO 线程自己的连接超时时间轮, 超时类别见 ConnectionTimeoutClass */
+    ConnectionTimeWheel::ptr getTimeWheel() { return m_time_wheel; }
+
+    /* 见 Reactor::setBusyPoll, 对延迟敏感的 IO 线程单独开启 */
+    void setBusyPoll(int max_spin_us, int sock_busy_poll_us = 0);
+
+    /* 把线程绑定到 cpu 上, cpu 为 -1 时解除绑定 */
+    bool setCpu(int cpu);
+    int getCpu() { return m_cpu; }
+
+    /* 分配到这个 IO 线程的连接数 */
+    void addConnection(int delta) { m_connection_count.fetch_add(delta); }
+    int getConnectionCount() { return m_connection_count.load(); }
+
 private:
     static void *main(void *arg);
 
     int m_index;
+    int m_cpu;
+    std::atomic_int m_connection_count;
     pid_t m_tid;
     pthread_t m_thread;
 
     Reactor *m_reactor;
     TimerEvent::ptr m_timer_event;
+    ConnectionTimeWheel::ptr m_time_wheel;
 
     sem_t m_init_sem;
     sem_t m_start_sem;
@@ -49,15 +77,36 @@ class IOThreadPool {
 public:
     typedef std::shared_ptr<IOThreadPool> ptr;
 
-    IOThreadPool(int size);
+    /* size <= 0 时每个可用 CPU (sched_getaffinity) 一个 IO 线程 */
+    IOThreadPool(int size = 0, CpuAffinityPolicy policy = CompactAffinity,
+                 const std::vector<int> &cpus = std::vector<int>());
 
     IOThread *getIOThread();
+    IOThread *getIOThread(int index);
     int getIOThreadPoolSize() { return m_size; }
 
     void start();
+    /* 停止所有 IO 线程, 见 IOThread::stop */
+    void stop();
+
+    /*
+     * 按策略重新绑定所有 IO 线程, 线程数多于 CPU 时循环使用
+     * ExplicitAffinity 使用 cpus, 其他策略忽略 cpus
+     */
+    void setCpuAffinity(CpuAffinityPolicy policy, const std::vector<int> &cpus = std::vector<int>());
+
+    /* 下标是 IO 线程的 index, 值是绑定的 CPU, -1 表示没有绑核 */
+    std::vector<int> getCpuMap();
+
+    /* 按同一策略留给 main reactor 的 CPU, -1 表示不绑核 */
+    int getMainCpu() { return m_main_cpu; }
+
+    /* 进程启动时可用的 CPU 列表 */
+    static std::vector<int> GetAvailableCpus();
 
 private:
    int m_size;
+   int m_main_cpu;
    std::atomic_int m_index;
    std::vector<IOThread::ptr> m_io_threads;
 };
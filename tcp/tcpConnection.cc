@@ -1,3 +1,7 @@
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
 #include "log.h"
 #include "ioThread.h"
 #include "tcpServer.h"
@@ -17,30 +21,44 @@ TcpConnection::TcpConnection(TcpServer *tcp_server, IOThread *io_thread,
                               m_io_thread(io_thread),
                               m_reactor(nullptr),
                               m_peer_addr(net_addr),
-                              m_connection_type(ServerConnection)  {
+                              m_connection_type(ServerConnection),
+                              m_phase_start_ms(0),
+                              m_header_scanned(0),
+                              m_header_size(0),
+                              m_body_size(0)  {
     
     m_reactor = m_io_thread->getReactor();
     m_fd_event = FdEventContainer::GetFdContainer()->getFdEvent(fd);
     m_fd_event->setReactor(m_reactor);
+    if(m_tcp_svr->isEdgeTriggered()) {
+        m_fd_event->setNonBlock();
+        m_fd_event->registerPersistent();
+    }
+
+    int busy_poll_us = m_reactor->getSockBusyPoll();
+    if(busy_poll_us > 0 && ::setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL, &busy_poll_us, sizeof(busy_poll_us)) != 0) {
+        LOG_ERROR << "setsockopt SO_BUSY_POLL error, fd = " << fd << ", sys error=" << strerror(errno);
+    }
     m_codec = m_tcp_svr->getCodec();
 
     initBuffer(buff_size);
     m_loop_cor = GetCoroutinePool()->getCoroutineInstance();
     m_state = Connected;
+    m_io_thread->addConnection(1);
 
     LOG_DEBUG << "succ create tcp connection state[" << m_state << "], fd = " << fd;
 }
 
 TcpConnection::~TcpConnection() {
     if(m_connection_type == ServerConnection) {
-        GetCoroutinePool()->backCoroutine(m_loop_cor);
+        m_tcp_svr->backCoroutine(m_loop_cor);
     }
 }
 
 void TcpConnection::initServer() {
     registerToTimeWheel();
     m_loop_cor->setCallback(std::bind(&TcpConnection::MainServerLoopCorFunc, this));
-    m_reactor->addCoroutine(m_loop_cor);
+    m_tcp_svr->addCoroutine(m_reactor, m_loop_cor);
 }
 
 void TcpConnection::initBuffer(int size) {
@@ -63,13 +81,13 @@ void TcpConnection::shutdownConnection() {
 }
 
 void TcpConnection::registerToTimeWheel() {
-    auto cb = [](TcpConnection::ptr conn) {
-        conn->shutdownConnection();
-    };
+    setTimeoutClass(FirstByteTimeout);
+}
 
-    TimeWheel::TcpConnectionSlot::ptr tmp = std::make_shared<AbstractSlot<TcpConnection>>(shared_from_this(), cb);
-    m_weak_slot = tmp;
-    m_tcp_svr->freshTcpConnection(tmp);
+void TcpConnection::setTimeoutClass(ConnectionTimeoutClass timeout_class) {
+    m_wheel_node.m_timeout_class.store(timeout_class, std::memory_order_relaxed);
+    m_phase_start_ms = getNowMs();
+    m_tcp_svr->freshTcpConnection(this);
 }
 
 void TcpConnection::MainServerLoopCorFunc() {
@@ -100,8 +118,12 @@ void TcpConnection::input() {
     int count = 0;
 
     while(!read_all) {
+        /* 请求可能分多次到达, 追加在没有处理完的数据后面, 写满了就扩容 */
+        if(m_read_buffer->writeableBytes() == 0) {
+            m_read_buffer->ensureWriteableBytes(m_read_buffer->getBufferSize());
+        }
         int read_count = m_read_buffer->writeableBytes();
-        char *write_index = m_read_buffer->peek();
+        char *write_index = m_read_buffer->beginWrite();
 
         int rt = read_hook(m_fd, write_index, read_count);
         LOG_DEBUG << "read hook rt = " << rt;
@@ -122,6 +144,14 @@ void TcpConnection::input() {
                 LOG_ERROR << "read empty while occur read event, because of peer close, fd = " << m_fd << ", sys error=" << strerror(errno) << ", now to clear tcp connection";
             close_flag = true;
             break;
+        }
+
+        /* 每读一次就推进请求的阶段, 请求头或请求体超过上限时不再继续扩容读取 */
+        if(m_connection_type == ServerConnection && !updateRequestPhase()) {
+            LOG_INFO << "request phase " << m_wheel_node.m_timeout_class.load(std::memory_order_relaxed)
+                     << " is too slow or too large, now to clear tcp connection, fd = " << m_fd;
+            close_flag = true;
+            break;
         } else {
             if(rt == read_count) {
                 // read again
@@ -146,12 +176,98 @@ void TcpConnection::input() {
         LOG_ERROR << "not read all data in socket buffer";
     }
     LOG_INFO << "recv [" << count << "] bytes data from [" << m_peer_addr->toString() << "], fd [" << m_fd << "]";
-    if(m_connection_type == ServerConnection) {
-        TimeWheel::TcpConnectionSlot::ptr tmp = m_weak_slot.lock();
-        if(tmp) {
-            m_tcp_svr->freshTcpConnection(tmp);
+}
+
+/* 请求头中的 Content-Length, 没有时为 0 */
+static size_t parseContentLength(const char *header, size_t len) {
+    static const char name[] = "content-length:";
+    size_t name_len = sizeof(name) - 1;
+    for(size_t i = 1; i + name_len <= len; i++) {
+        if(header[i - 1] == '\n' && ::strncasecmp(header + i, name, name_len) == 0) {
+            return (size_t)::strtoull(header + i + name_len, nullptr, 10);
         }
     }
+    return 0;
+}
+
+bool TcpConnection::updateRequestPhase() {
+    int timeout_class = m_wheel_node.m_timeout_class.load(std::memory_order_relaxed);
+    /* 长轮询由处理方自己切回来, 其他协议没有请求的边界, 收到数据就算请求完整 */
+    if(timeout_class == LongPollTimeout || m_tcp_svr->getProtocalType() != HTTP) {
+        if(timeout_class == FirstByteTimeout) {
+            setTimeoutClass(IdleTimeout);
+        } else {
+            m_tcp_svr->freshTcpConnection(this);
+        }
+        return true;
+    }
+
+    if(timeout_class == FirstByteTimeout || timeout_class == IdleTimeout) {
+        m_header_scanned = 0;
+        m_header_size = 0;
+        m_body_size = 0;
+        setTimeoutClass(RequestHeaderTimeout);
+        timeout_class = RequestHeaderTimeout;
+    }
+
+    ConnectionTimeWheel::ptr time_wheel = m_io_thread->getTimeWheel();
+    int64_t now = getNowMs();
+    int64_t elapsed = now - m_phase_start_ms;
+    int64_t timeout = time_wheel->getTimeout(timeout_class);
+    if(timeout > 0 && elapsed > timeout) {
+        return false;
+    }
+
+    const char *data = m_read_buffer->peek();
+    size_t readable = m_read_buffer->readableBytes();
+
+    if(timeout_class == RequestHeaderTimeout) {
+        /* 从上次找到的位置往前退 3 个字节接着找, 一个字节一个字节发过来时不会重复扫描 */
+        size_t start = m_header_scanned > 3 ? m_header_scanned - 3 : 0;
+        const char *end = (const char *)::memmem(data + start, readable - start, "\r\n\r\n", 4);
+        m_header_scanned = readable;
+        int64_t max_header = m_tcp_svr->getMaxHeaderSize();
+        if(end == nullptr) {
+            return max_header <= 0 || (int64_t)m_header_scanned <= max_header;
+        }
+
+        m_header_size = end - data + 4;
+        if(max_header > 0 && (int64_t)m_header_size > max_header) {
+            return false;
+        }
+        m_body_size = parseContentLength(data, m_header_size);
+        int64_t max_body = m_tcp_svr->getMaxBodySize();
+        if(max_body > 0 && m_body_size > (size_t)max_body) {
+            return false;
+        }
+        if(m_body_size == 0) {
+            setTimeoutClass(IdleTimeout);
+            return true;
+        }
+        setTimeoutClass(RequestBodyTimeout);
+        timeout_class = RequestBodyTimeout;
+        elapsed = 0;
+    }
+
+    if(timeout_class == RequestBodyTimeout) {
+        size_t received = readable - m_header_size;
+        if(received >= m_body_size) {
+            setTimeoutClass(IdleTimeout);
+            return true;
+        }
+
+        /* 开始的 1s 不检查, 给慢启动留出时间 */
+        int64_t min_rate = m_tcp_svr->getMinBodyRate();
+        if(min_rate > 0 && elapsed >= 1000 && (int64_t)received * 1000 / elapsed < min_rate) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool TcpConnection::isRequestComplete() {
+    int timeout_class = m_wheel_node.m_timeout_class.load(std::memory_order_relaxed);
+    return timeout_class != RequestHeaderTimeout && timeout_class != RequestBodyTimeout;
 }
 
 void TcpConnection::execute() {
@@ -166,6 +282,11 @@ void TcpConnection::execute() {
         return ;
     }
 
+    if(!isRequestComplete()) {
+        LOG_DEBUG << "request of fd = " << m_fd << " is not complete, wait for more data";
+        return ;
+    }
+
     while(m_read_buffer->readableBytes() > 0) {
         std::shared_ptr<AbstractData> data;
         if(m_tcp_svr->getProtocalType() == HTTP) {
@@ -243,11 +364,18 @@ void TcpConnection::clearClient() {
         return ;
     }
 
+    /*
+     * 连接的协程在 fd 所在 reactor 的线程中, 这里同步删除注册并清掉 reactor 缓存的事件和常驻状态
+     * 必须在 close 之前, 否则复用这个 fd 号的连接注册相同的事件时会被当成没有变化跳过
+     */
     m_fd_event->unregisterFromReactor();
     
     m_stop = true;
     ::close(m_fd_event->getFd());
     setState(Closed);
+    /* 先设置 Closed, 之后才到达的刷新消息不会再把连接放回时间轮 */
+    m_tcp_svr->removeTcpConnection(this);
+    m_io_thread->addConnection(-1);
 }
 
 }   // namespace util
\ No newline at end of file
@@ -9,8 +9,8 @@
 #include "buffer.h"
 #include "fdEvent.h"
 #include "coroutine.h"
+#include "timeWheel.h"
 #include "netAddress.h"
-#include "abstactSlot.h"
 #include "abstractCodec.h"
 
 namespace util {
@@ -18,6 +18,19 @@ namespace util {
 class TcpServer;
 class IOThread;
 
+/*
+ * 连接在时间轮中的超时类别, 也是请求所处的阶段, 超时的值见 TcpServer::setConnectionTimeout
+ * 请求头和请求体阶段从阶段开始计时, 期间收到数据不会刷新
+ */
+enum ConnectionTimeoutClass {
+    FirstByteTimeout = 0,       // 新连接等待请求的第一个字节
+    IdleTimeout = 1,            // keep-alive 连接等待下一个请求的第一个字节
+    RequestHeaderTimeout = 2,   // 从请求的第一个字节到请求头接收完
+    RequestBodyTimeout = 3,     // 从请求头接收完到请求体接收完
+    LongPollTimeout = 4,        // 长轮询, 服务端挂起请求等待数据
+    ConnectionTimeoutClassCount = 5
+};
+
 enum TcpConnectionState {
     NotConnected = 1,
     Connected = 2,
@@ -44,6 +57,8 @@ public:
     void shutdownConnection();
 
     void registerToTimeWheel();
+    /* 切换超时类别并刷新, 比如长轮询挂起请求之前切到 LongPollTimeout, 返回响应后切回 IdleTimeout */
+    void setTimeoutClass(ConnectionTimeoutClass timeout_class);
 
     void MainServerLoopCorFunc();
     void input();
@@ -57,6 +72,8 @@ public:
     Coroutine::ptr getCoroutine() { return m_loop_cor; }
     Buffer *getReadBuffer() { return m_read_buffer.get(); }
     Buffer *getWriteBuffer() { return m_write_buffer.get(); }
+    IOThread *getIOThread() { return m_io_thread; }
+    TimeWheelNode<TcpConnection> *getTimeWheelNode() { return &m_wheel_node; }
 
     void setOverTimeFlag(bool value) { m_is_overtime = value; }
     bool getOverTimeFlag() { return m_is_overtime; }
@@ -64,6 +81,14 @@ public:
 private:
     void clearClient();
 
+    /*
+     * 收到数据后推进请求的阶段, 请求完整时切回 IdleTimeout
+     * 返回 false 表示当前阶段超时、请求体的速率太低或者请求头 / 请求体超过上限, 需要关闭连接
+     */
+    bool updateRequestPhase();
+    /* 请求头和请求体都收完了才交给 codec */
+    bool isRequestComplete();
+
     int m_fd;
     bool m_stop;
     bool m_is_overtime;
@@ -83,12 +108,18 @@ private:
     Coroutine::ptr m_loop_cor;
     FdEvent::ptr m_fd_event;
 
-    std::weak_ptr<AbstractSlot<TcpConnection>> m_weak_slot;
+    TimeWheelNode<TcpConnection> m_wheel_node;
+    int64_t m_phase_start_ms;   // 当前阶段开始的时间
+    size_t m_header_scanned;    // 已经找过请求头结束标记的字节数
+    size_t m_header_size;       // 请求头的长度, 包括结尾的空行
+    size_t m_body_size;         // Content-Length
 
     RWMutex m_mutex;
 
 };
 
+typedef TimeWheel<TcpConnection> ConnectionTimeWheel;
+
 }   // namespace util
 
 #endif
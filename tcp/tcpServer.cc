@@ -1,3 +1,5 @@
+#include <sched.h>
+#include <pthread.h>
 #include <string.h>
 #include <sys/types.h>
 #include <sys/socket.h>
@@ -85,11 +87,15 @@ int TcpAcceptor::toAccept() {
 }
 
 
-TcpServer::TcpServer(NetAddress::ptr addr, ProtocalType type /*= HTTP*/)
+TcpServer::TcpServer(NetAddress::ptr addr, ProtocalType type /*= HTTP*/, int io_thread_num /*= 0*/)
     : m_tcp_counts(0),
       m_is_stop_accept(false),
+      m_is_edge_triggered(false),
       m_main_reactor(nullptr),
-      m_addr(addr) {
+      m_addr(addr),
+      m_min_body_rate(500),
+      m_max_header_size(8 * 1024),
+      m_max_body_size(1024 * 1024) {
 
     if(type == HTTP) {
         m_dispatcher = std::make_shared<HttpDispatcher>();
@@ -102,15 +108,33 @@ TcpServer::TcpServer(NetAddress::ptr addr, ProtocalType type /*= HTTP*/)
     m_main_reactor = Reactor::GetReactor();
     m_main_reactor->setReactorType(MainReactor);
 
-    m_io_pool = std::make_shared<IOThreadPool>(10);
+    m_io_pool = std::make_shared<IOThreadPool>(io_thread_num);
 
-    m_time_wheel = std::make_shared<TimeWheel>(m_main_reactor, 10, 10);
-    m_clear_client_event = std::make_shared<TimerEvent>(10000, true, std::bind(&TcpServer::ClearClientTimerFunc, this));
+    std::vector<Reactor *> reactors(1, m_main_reactor);
+    for(int i = 0; i < m_io_pool->getIOThreadPoolSize(); i++) {
+        reactors.push_back(m_io_pool->getIOThread(i)->getReactor());
+    }
+    m_mailbox = std::make_shared<MailboxGrid<ServerMessage>>(reactors,
+                    std::bind(&TcpServer::handleMessage, this, std::placeholders::_1));
+
+    /* 清理已关闭的连接, 晚 1s 执行也没关系 */
+    m_clear_client_event = std::make_shared<TimerEvent>(10000, true, std::bind(&TcpServer::ClearClientTimerFunc, this), 1000);
     m_main_reactor->getTimer()->addTimerEvent(m_clear_client_event);
 }
 
 TcpServer::~TcpServer() {
-    GetCoroutinePool()->backCoroutine(m_accept_cor);
+    /*
+     * MailboxGrid 要在组内的 reactor 停止之后、释放之前析构, 而 IO 线程的 reactor 在 IOThread 析构时释放
+     * 所以先停止 IO 线程, 再释放 mailbox, 最后释放线程池
+     */
+    m_io_pool->stop();
+    m_mailbox.reset();
+    m_io_pool.reset();
+
+    /* 没有 start() 过时没有 accept 协程 */
+    if(m_accept_cor) {
+        GetCoroutinePool()->backCoroutine(m_accept_cor);
+    }
 }
 
 void TcpServer::start() {
@@ -123,6 +147,19 @@ void TcpServer::start() {
     LOG_INFO << "TcpServer::start - resume accept coroutine";
     Coroutine::Resume(m_accept_cor.get());
 
+    int main_cpu = m_io_pool->getMainCpu();
+    if(main_cpu >= 0) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(main_cpu, &set);
+        int rt = ::pthread_setaffinity_np(::pthread_self(), sizeof(set), &set);
+        if(rt != 0) {
+            LOG_ERROR << "TcpServer::start - bind main reactor to cpu " << main_cpu << " error, sys error=" << strerror(rt);
+        } else {
+            LOG_INFO << "TcpServer::start - bind main reactor to cpu " << main_cpu;
+        }
+    }
+
     m_io_pool->start();
     m_main_reactor->loop();
 }
@@ -160,14 +197,112 @@ TcpConnection::ptr TcpServer::addClient(IOThread *io_thread, int fd) {
     }
 }
 
-void TcpServer::freshTcpConnection(TimeWheel::TcpConnectionSlot::ptr slot) {
-    auto cb = [slot, this]() mutable {
-        this->getTimeWheel()->fresh(slot);
-        slot.reset();
+void TcpServer::freshTcpConnection(TcpConnection *conn) {
+    /* 每个 IO 线程有自己的时间轮, 在连接的 IO 线程中刷新不加锁也不唤醒其他线程 */
+    IOThread *io_thread = conn->getIOThread();
+    if(IOThread::GetCurrentThread() == io_thread) {
+        io_thread->getTimeWheel()->fresh(conn);
+        return ;
+    }
+
+    /* main reactor 上 accept 之后第一次注册 */
+    sendToIOThread(ServerMessage::FreshConnection, conn);
+}
+
+void TcpServer::removeTcpConnection(TcpConnection *conn) {
+    /* 时间轮只能在所在的线程中移除, 其他线程中不处理的话, 关闭的连接要留到超时才释放 */
+    IOThread *io_thread = conn->getIOThread();
+    if(IOThread::GetCurrentThread() == io_thread) {
+        io_thread->getTimeWheel()->remove(conn);
+        return ;
+    }
+
+    sendToIOThread(ServerMessage::RemoveConnection, conn);
+}
+
+void TcpServer::sendToIOThread(ServerMessage::Type type, TcpConnection *conn) {
+    IOThread *io_thread = conn->getIOThread();
+    ServerMessage msg;
+    msg.type = type;
+    msg.conn = conn->shared_from_this();
+    if(Reactor::GetCurrentReactor() != nullptr && m_mailbox->sendTo(io_thread->getReactor(), std::move(msg))) {
+        return ;
+    }
+
+    TcpConnection::ptr tmp = conn->shared_from_this();
+    auto cb = [this, type, tmp]() mutable {
+        ServerMessage msg;
+        msg.type = type;
+        msg.conn.swap(tmp);
+        handleMessage(msg);
+    };
+    io_thread->getReactor()->addTask(cb);
+}
+
+void TcpServer::setConnectionTimeout(ConnectionTimeoutClass timeout_class, int64_t timeout_ms) {
+    for(int i = 0; i < m_io_pool->getIOThreadPoolSize(); i++) {
+        m_io_pool->getIOThread(i)->getTimeWheel()->setTimeout(timeout_class, timeout_ms);
+    }
+    LOG_INFO << "TcpServer set connection timeout, class = " << timeout_class << ", timeout = " << timeout_ms << "ms";
+}
+
+int64_t TcpServer::getConnectionTimeout(ConnectionTimeoutClass timeout_class) {
+    return m_io_pool->getIOThread(0)->getTimeWheel()->getTimeout(timeout_class);
+}
+
+void TcpServer::setMinBodyRate(int64_t bytes_per_second) {
+    m_min_body_rate.store(bytes_per_second, std::memory_order_relaxed);
+    LOG_INFO << "TcpServer set min body rate = " << bytes_per_second << " bytes/s";
+}
+
+int64_t TcpServer::getMinBodyRate() {
+    return m_min_body_rate.load(std::memory_order_relaxed);
+}
+
+void TcpServer::setMaxHeaderSize(int64_t bytes) {
+    m_max_header_size.store(bytes, std::memory_order_relaxed);
+    LOG_INFO << "TcpServer set max header size = " << bytes << " bytes";
+}
+
+int64_t TcpServer::getMaxHeaderSize() {
+    return m_max_header_size.load(std::memory_order_relaxed);
+}
+
+void TcpServer::setMaxBodySize(int64_t bytes) {
+    m_max_body_size.store(bytes, std::memory_order_relaxed);
+    LOG_INFO << "TcpServer set max body size = " << bytes << " bytes";
+}
+
+int64_t TcpServer::getMaxBodySize() {
+    return m_max_body_size.load(std::memory_order_relaxed);
+}
+
+void TcpServer::backCoroutine(Coroutine::ptr cor) {
+    if(Reactor::GetCurrentReactor() == m_main_reactor) {
+        GetCoroutinePool()->backCoroutine(cor);
+        return ;
+    }
+
+    auto cb = [cor]() mutable {
+        GetCoroutinePool()->backCoroutine(cor);
+        cor.reset();
     };
     m_main_reactor->addTask(cb);
 }
 
+void TcpServer::handleMessage(ServerMessage &msg) {
+    if(msg.type == ServerMessage::ResumeCoroutine) {
+        Reactor::GetCurrentReactor()->resumeCoroutine(msg.cor.get());
+    } else if(msg.type == ServerMessage::FreshConnection) {
+        /* 不同线程投递的消息之间没有顺序, 已经关闭的连接不再放回去 */
+        if(msg.conn->getState() != Closed) {
+            msg.conn->getIOThread()->getTimeWheel()->fresh(msg.conn.get());
+        }
+    } else if(msg.type == ServerMessage::RemoveConnection) {
+        msg.conn->getIOThread()->getTimeWheel()->remove(msg.conn.get());
+    }
+}
+
 void TcpServer::ClearClientTimerFunc() {
     for(auto &cli : m_clients) {
         if(cli.second && cli.second.use_count() > 0 && cli.second->getState() == Closed) {
@@ -195,10 +330,32 @@ bool TcpServer::registerHttpServlet(const std::string& url_path, HttpServlet::pt
     return true;
 }
 
+void TcpServer::setEdgeTriggered(bool value) {
+    m_is_edge_triggered = value;
+}
+
+bool TcpServer::isEdgeTriggered() {
+    return m_is_edge_triggered;
+}
+
+void TcpServer::setCpuAffinity(CpuAffinityPolicy policy, const std::vector<int> &cpus /*= std::vector<int>()*/) {
+    m_io_pool->setCpuAffinity(policy, cpus);
+}
+
 void TcpServer::addCoroutine(Coroutine::ptr cor) {
     m_main_reactor->addCoroutine(cor);
 }
 
+void TcpServer::addCoroutine(Reactor *reactor, Coroutine::ptr cor) {
+    ServerMessage msg;
+    msg.type = ServerMessage::ResumeCoroutine;
+    msg.cor = cor;
+    if(Reactor::GetCurrentReactor() != nullptr && m_mailbox->sendTo(reactor, std::move(msg))) {
+        return ;
+    }
+    reactor->addCoroutine(cor);
+}
+
 NetAddress::ptr TcpServer::getPeerAddr() {
     return m_acceptor->getPeerAddr();
 }
@@ -207,10 +364,6 @@ NetAddress::ptr TcpServer::getLocalAddr() {
     return m_addr;
 }
 
-TimeWheel::ptr TcpServer::getTimeWheel() {
-    return m_time_wheel;
-}
-
 IOThreadPool::ptr TcpServer::getIOThreadPool() {
     return m_io_pool;
 }
@@ -2,6 +2,7 @@
 #define _TCPSERVER_H
 
 #include <map>
+#include <atomic>
 #include <memory>
 #include <functional>
 
@@ -10,6 +11,7 @@
 #include "timeWheel.h"
 #include "coroutine.h"
 #include "netAddress.h"
+#include "mailboxGrid.h"
 #include "httpServlet.h"
 #include "tcpConnection.h"
 #include "abstractDispatcher.h"
@@ -41,20 +43,55 @@ class TcpServer {
 public:
     typedef std::shared_ptr<TcpServer> ptr;
 
-    TcpServer(NetAddress::ptr addr, ProtocalType type = HTTP);
+    /* io_thread_num <= 0 时每个可用 CPU 一个 IO 线程 */
+    TcpServer(NetAddress::ptr addr, ProtocalType type = HTTP, int io_thread_num = 0);
     ~TcpServer();
 
     void start();
 
     void addCoroutine(Coroutine::ptr cor);
+    /* 在 reactor 上恢复协程, reactor 属于这个 TcpServer 时通过 mailbox 投递 */
+    void addCoroutine(Reactor *reactor, Coroutine::ptr cor);
     TcpConnection::ptr addClient(IOThread *io_thread, int fd);
     
-    void freshTcpConnection(TimeWheel::TcpConnectionSlot::ptr slot);
+    /* 刷新连接在它的 IO 线程的时间轮中的位置; 不在这个 IO 线程中调用时 (比如 main reactor) 投递给它 */
+    void freshTcpConnection(TcpConnection *conn);
+    /* 把连接移出它的 IO 线程的时间轮, 投递的方式同上 */
+    void removeTcpConnection(TcpConnection *conn);
+    /*
+     * 连接各个超时类别的超时, 可以在运行时从任意线程调用, timeout_ms <= 0 表示不超时
+     * 默认 FirstByteTimeout 20s, IdleTimeout 100s, RequestHeaderTimeout 20s, RequestBodyTimeout 60s, LongPollTimeout 300s
+     * 已经在时间轮中的连接, 超时变长时到原来的到期时间生效, 变短时在下一次刷新时生效
+     */
+    void setConnectionTimeout(ConnectionTimeoutClass timeout_class, int64_t timeout_ms);
+    int64_t getConnectionTimeout(ConnectionTimeoutClass timeout_class);
+
+    /* 请求体阶段开始 1s 之后, 平均速率低于 bytes_per_second 的连接直接关闭, 0 表示不限制, 默认 500 */
+    void setMinBodyRate(int64_t bytes_per_second);
+    int64_t getMinBodyRate();
+
+    /* 请求头 (包括结尾的空行) 和 Content-Length 的上限, 超过的连接直接关闭, 0 表示不限制, 默认 8KB 和 1MB */
+    void setMaxHeaderSize(int64_t bytes);
+    int64_t getMaxHeaderSize();
+    void setMaxBodySize(int64_t bytes);
+    int64_t getMaxBodySize();
+
+    /*
+     * 协程池是全局共享的, backCoroutine 和 getCoroutineInstance 都不加锁
+     * 连接的协程在 main reactor 的线程中分配, 在其他线程析构时投递回 main reactor 归还
+     */
+    void backCoroutine(Coroutine::ptr cor);
     bool registerHttpServlet(const std::string& url_path, HttpServlet::ptr servlet);
 
+    /* 新连接以边缘触发常驻注册到 IO 线程的 epoll, 需要在 start() 之前设置 */
+    void setEdgeTriggered(bool value);
+    bool isEdgeTriggered();
+
+    /* IO 线程的绑核策略, 默认 CompactAffinity; main reactor 在 start() 时绑到 IOThreadPool::getMainCpu() */
+    void setCpuAffinity(CpuAffinityPolicy policy, const std::vector<int> &cpus = std::vector<int>());
+
     NetAddress::ptr getPeerAddr();
     NetAddress::ptr getLocalAddr();
-    TimeWheel::ptr getTimeWheel();
     IOThreadPool::ptr getIOThreadPool();
 
     ProtocalType getProtocalType();
@@ -62,11 +99,31 @@ public:
     AbstractDispatcher::ptr getDispatcher();
 
 private:
+    /* main reactor 和 IO 线程之间通过 MailboxGrid 传递的消息 */
+    struct ServerMessage {
+        enum Type {
+            ResumeCoroutine = 1,    // 接收方恢复 cor (accept 之后把连接的协程交给 IO 线程)
+            FreshConnection = 2,    // 接收方 IO 线程把 conn 放进自己的时间轮
+            RemoveConnection = 3    // 接收方 IO 线程把 conn 移出自己的时间轮
+        };
+
+        ServerMessage() : type(ResumeCoroutine) {}
+
+        Type type;
+        Coroutine::ptr cor;
+        TcpConnection::ptr conn;
+    };
+
+    /* 投递给 conn 的 IO 线程, 不在 reactor 中调用时退回 addTask */
+    void sendToIOThread(ServerMessage::Type type, TcpConnection *conn);
+    void handleMessage(ServerMessage &msg);
+
     void MainAcceptCorFunc();
     void ClearClientTimerFunc();
 
     int m_tcp_counts;
     bool m_is_stop_accept;
+    bool m_is_edge_triggered;
     
     Reactor *m_main_reactor;
 
@@ -79,11 +136,14 @@ private:
     ProtocalType m_protocal_type;
 
     IOThreadPool::ptr m_io_pool;
-    TimeWheel::ptr m_time_wheel;
+    std::shared_ptr<MailboxGrid<ServerMessage>> m_mailbox;
 
     std::map<int, std::shared_ptr<TcpConnection>> m_clients;
     
     TimerEvent::ptr m_clear_client_event;
+    std::atomic<int64_t> m_min_body_rate;
+    std::atomic<int64_t> m_max_header_size;
+    std::atomic<int64_t> m_max_body_size;
 };
 
 }   // namespace util
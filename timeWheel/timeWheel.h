@@ -1,34 +1,258 @@
 #ifndef _TIMEWHEEL_H
 #define _TIMEWHEEL_H
 
-#include <queue>
+#include <atomic>
+#include <memory>
 #include <vector>
+#include <functional>
+#include <stdint.h>
 
+#include "log.h"
 #include "timer.h"
 #include "reactor.h"
-#include "abstactSlot.h"
-#include "tcpConnection.h"
 
 namespace util {
 
+/*
+ * 嵌入在被管理的对象中的时间轮节点, 每个对象一个
+ * m_timeout_class 和 m_active_ms 任何线程都可以写, 其余只有时间轮所在的线程访问
+ */
+template <class T>
+struct TimeWheelNode {
+    TimeWheelNode()
+        : m_prev(nullptr),
+          m_next(nullptr),
+          m_bucket(-1),
+          m_expire_ms(0),
+          m_timeout_class(0),
+          m_active_ms(0) {}
+
+    TimeWheelNode *m_prev;
+    TimeWheelNode *m_next;
+    int m_bucket;                       // -1 表示不在时间轮中
+    int64_t m_expire_ms;                // 所在的桶到期的时间
+    std::atomic<int> m_timeout_class;
+    std::atomic<int64_t> m_active_ms;   // 最后一次刷新的时间
+    std::shared_ptr<T> m_item;          // 在时间轮中时持有对象, 保证节点的内存有效
+};
+
+/*
+ * 毫秒精度的单层时间轮, 每个 reactor 一个, 挂在它的定时器上每 tick_ms 毫秒转一格
+ * 每个桶是一个侵入式双向链表; 每个对象按自己的超时类别计算到期时间, 类别的超时可以在运行时修改
+ * 刷新只更新节点的活跃时间, 所在的桶到期时再按活跃时间和当前的超时放回去, 没有再被刷新过的才到期
+ * 超过一圈的超时先放到最远的桶, 到期时同样放回去
+ *
+ * T 需要继承 std::enable_shared_from_this<T>, 并提供 TimeWheelNode<T> *getTimeWheelNode()
+ */
+template <class T>
 class TimeWheel {
 public:
     typedef std::shared_ptr<TimeWheel> ptr;
-    typedef AbstractSlot<TcpConnection> TcpConnectionSlot;
+    typedef TimeWheelNode<T> Node;
+    typedef std::function<void(const std::shared_ptr<T> &)> ExpireCallback;
+
+    TimeWheel(Reactor *reactor, int64_t tick_ms, int bucket_count, int class_count, ExpireCallback cb)
+        : m_reactor(reactor),
+          m_tick_ms(tick_ms),
+          m_bucket_count(bucket_count),
+          m_buckets(bucket_count, nullptr),
+          m_current(0),
+          m_current_ms(getNowMs()),
+          m_count(0),
+          m_timeouts(class_count),
+          m_expire_cb(cb) {
+
+        for(int i = 0; i < class_count; i++) {
+            m_timeouts[i].store(0, std::memory_order_relaxed);
+        }
+
+        /* 超时不需要很精确, 允许推迟一个 tick 的 1/10, 和其他定时器合并成一次唤醒 */
+        m_timer_event = std::make_shared<TimerEvent>(tick_ms, true, std::bind(&TimeWheel::loop, this), tick_ms / 10);
+        m_reactor->getTimer()->addTimerEvent(m_timer_event);
+    }
+
+    ~TimeWheel() {
+        // m_timer_event's is_repeated is true, so delete it
+        m_reactor->getTimer()->delTimerEvent(m_timer_event);
 
-    TimeWheel(Reactor *reactor, int bucket_count, int interval = 10);
-    ~TimeWheel();
+        for(int i = 0; i < m_bucket_count; i++) {
+            while(m_buckets[i]) {
+                release(m_buckets[i]);
+            }
+        }
+    }
 
-    void fresh(TcpConnectionSlot::ptr slot);
-    void loop();
+    /* 任意线程调用, 之后的刷新和到期检查使用新的值; timeout_ms <= 0 表示这一类不超时 */
+    void setTimeout(int timeout_class, int64_t timeout_ms) {
+        if(timeout_class < 0 || timeout_class >= (int)m_timeouts.size()) {
+            LOG_ERROR << "TimeWheel::setTimeout invalid timeout class = " << timeout_class;
+            return ;
+        }
+        m_timeouts[timeout_class].store(timeout_ms, std::memory_order_relaxed);
+    }
+
+    int64_t getTimeout(int timeout_class) const {
+        if(timeout_class < 0 || timeout_class >= (int)m_timeouts.size()) {
+            return 0;
+        }
+        return m_timeouts[timeout_class].load(std::memory_order_relaxed);
+    }
+
+    /*
+     * 刷新对象的活跃时间, 按节点当前的超时类别计算到期时间
+     * 在时间轮所在的线程中调用时, 不在时间轮中的对象放进去, 到期时间提前了 (换到更短的类别) 的移到对应的桶
+     * 在其他线程中只记下活跃时间, 对象所在的桶到期时生效
+     */
+    void fresh(T *item) {
+        Node *node = item->getTimeWheelNode();
+        int64_t now = getNowMs();
+        node->m_active_ms.store(now, std::memory_order_relaxed);
+        if(!isOwnerThread()) {
+            return ;
+        }
+
+        int64_t timeout = getTimeout(node->m_timeout_class.load(std::memory_order_relaxed));
+        if(timeout <= 0) {
+            if(node->m_bucket != -1) {
+                release(node);
+            }
+            return ;
+        }
+
+        int64_t deadline = now + timeout;
+        if(node->m_bucket != -1) {
+            if(deadline >= node->m_expire_ms) {
+                return ;
+            }
+            unlink(node);
+        } else {
+            node->m_item = item->shared_from_this();
+        }
+        place(node, deadline);
+    }
+
+    /* 移出时间轮, 只在时间轮所在的线程中生效, 其他线程需要投递给所在的线程调用 */
+    void remove(T *item) {
+        Node *node = item->getTimeWheelNode();
+        if(!isOwnerThread() || node->m_bucket == -1) {
+            return ;
+        }
+        release(node);
+    }
+
+    size_t size() const { return m_count; }
 
 private:
+    TimeWheel(const TimeWheel &) = delete;
+    TimeWheel &operator=(const TimeWheel &) = delete;
+
+    bool isOwnerThread() const {
+        return Reactor::GetCurrentReactor() == m_reactor;
+    }
+
+    void loop() {
+        /* 定时器可能晚到, 把这期间经过的桶都处理掉 */
+        int64_t now = getNowMs();
+        int steps = 0;
+        while(m_current_ms + m_tick_ms <= now && steps < m_bucket_count) {
+            m_current = (m_current + 1) % m_bucket_count;
+            m_current_ms += m_tick_ms;
+            expireBucket(now);
+            steps++;
+        }
+
+        /* 落后超过一圈, 所有的桶都已经处理过了 */
+        if(m_current_ms + m_tick_ms <= now) {
+            m_current_ms = now - (now - m_current_ms) % m_tick_ms;
+        }
+    }
+
+    void expireBucket(int64_t now) {
+        /* 回调中可能刷新或移除其他节点, 每次只从桶的头部取一个 */
+        while(m_buckets[m_current]) {
+            Node *node = m_buckets[m_current];
+            unlink(node);
+
+            int64_t timeout = getTimeout(node->m_timeout_class.load(std::memory_order_relaxed));
+            if(timeout <= 0) {
+                releaseUnlinked(node);
+                continue;
+            }
+
+            int64_t deadline = node->m_active_ms.load(std::memory_order_relaxed) + timeout;
+            if(deadline > now) {
+                place(node, deadline);
+                continue;
+            }
+
+            std::shared_ptr<T> item;
+            item.swap(node->m_item);
+            if(m_expire_cb) {
+                m_expire_cb(item);
+            }
+        }
+    }
+
+    /* 放进 deadline 所在的桶, 至少是下一个桶, 最多是最远的桶 */
+    void place(Node *node, int64_t deadline) {
+        int64_t ticks = (deadline - m_current_ms + m_tick_ms - 1) / m_tick_ms;
+        if(ticks < 1) {
+            ticks = 1;
+        } else if(ticks > m_bucket_count - 1) {
+            ticks = m_bucket_count - 1;
+        }
+
+        int bucket = (m_current + (int)ticks) % m_bucket_count;
+        node->m_bucket = bucket;
+        node->m_expire_ms = m_current_ms + ticks * m_tick_ms;
+        node->m_prev = nullptr;
+        node->m_next = m_buckets[bucket];
+        if(node->m_next) {
+            node->m_next->m_prev = node;
+        }
+        m_buckets[bucket] = node;
+        m_count++;
+    }
+
+    void unlink(Node *node) {
+        if(node->m_prev) {
+            node->m_prev->m_next = node->m_next;
+        } else {
+            m_buckets[node->m_bucket] = node->m_next;
+        }
+        if(node->m_next) {
+            node->m_next->m_prev = node->m_prev;
+        }
+        node->m_prev = node->m_next = nullptr;
+        node->m_bucket = -1;
+        m_count--;
+    }
+
+    void release(Node *node) {
+        unlink(node);
+        releaseUnlinked(node);
+    }
+
+    /* 可能是最后一个引用, 摘下来之后再释放 */
+    void releaseUnlinked(Node *node) {
+        std::shared_ptr<T> tmp;
+        tmp.swap(node->m_item);
+    }
+
     Reactor *m_reactor;
+    int64_t m_tick_ms;
     int m_bucket_count;
-    int m_interval;     // second
 
     TimerEvent::ptr m_timer_event;
-    std::queue<std::vector<TcpConnectionSlot::ptr>> m_wheel;
+    /* 每个桶链表的头, m_current 是已经处理过的最后一个桶, 对应的时间是 m_current_ms */
+    std::vector<Node *> m_buckets;
+    int m_current;
+    int64_t m_current_ms;
+    size_t m_count;
+
+    /* 下标是超时类别 */
+    std::vector<std::atomic<int64_t>> m_timeouts;
+    ExpireCallback m_expire_cb;
 };
 
 }   // namespace util
@@ -0,0 +1,37 @@
+#include <time.h>
+
+#include "clock.h"
+
+namespace util {
+
+static thread_local bool t_cache_enabled = false;
+static thread_local int64_t t_now_ns = 0;
+
+static int64_t readMonotonicNs() {
+    timespec ts;
+    ::clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+int64_t Clock::NowNs() {
+    return t_cache_enabled ? t_now_ns : readMonotonicNs();
+}
+
+int64_t Clock::Refresh() {
+    t_now_ns = readMonotonicNs();
+    t_cache_enabled = true;
+    return t_now_ns;
+}
+
+void Clock::DisableCache() {
+    t_cache_enabled = false;
+}
+
+void Clock::CoarseWallTime(timeval *tv) {
+    timespec ts;
+    ::clock_gettime(CLOCK_REALTIME_COARSE, &ts);
+    tv->tv_sec = ts.tv_sec;
+    tv->tv_usec = ts.tv_nsec / 1000;
+}
+
+}   // namespace util
@@ -0,0 +1,32 @@
+#ifndef _CLOCK_H
+#define _CLOCK_H
+
+#include <stdint.h>
+#include <sys/time.h>
+
+namespace util {
+
+/*
+ * 单调时钟 (CLOCK_MONOTONIC), 不受修改系统时间和 NTP 跳变的影响
+ * reactor 每轮 loop 调用 Refresh() 把当前时间缓存到线程局部变量, 这一轮里的 Now*() 都直接返回缓存的值,
+ * 所以同一轮中创建的定时器以这一轮开始的时间为起点; 需要精确时间时自己调用 Refresh()
+ * 没有开启缓存的线程 (没有运行 reactor loop) 每次都重新读取
+ */
+class Clock {
+public:
+    static int64_t NowNs();
+    static int64_t NowUs() { return NowNs() / 1000; }
+    static int64_t NowMs() { return NowNs() / 1000000; }
+
+    /* 重新读取并开启当前线程的缓存, 返回纳秒 */
+    static int64_t Refresh();
+    /* 关闭当前线程的缓存, reactor 退出 loop 时调用 */
+    static void DisableCache();
+
+    /* 墙上时间, 用 CLOCK_REALTIME_COARSE, 精度是一个 tick (一般 1 ~ 4ms), 只用于日志这类显示给人看的时间 */
+    static void CoarseWallTime(timeval *tv);
+};
+
+}   // namespace util
+
+#endif
@@ -9,14 +9,20 @@ namespace util {
 static FdEventContainer *g_FdContainer = nullptr;
 
 FdEvent::FdEvent(Reactor *reactor, int fd /*= -1*/) 
-    : m_reactor(reactor), 
-      m_fd(fd), 
-      m_listen_events(0) {}
+    : m_fd(fd), 
+      m_listen_events(0),
+      m_wait_events(0),
+      m_is_persistent(false),
+      m_reactor(reactor),
+      m_coroutine(nullptr) {}
 
 FdEvent::FdEvent(int fd /*= -1*/)
-    : m_reactor(nullptr), 
-      m_fd(fd), 
-      m_listen_events(0) {}
+    : m_fd(fd), 
+      m_listen_events(0),
+      m_wait_events(0),
+      m_is_persistent(false),
+      m_reactor(nullptr),
+      m_coroutine(nullptr) {}
 
 FdEvent::~FdEvent() {}
 
@@ -124,6 +130,25 @@ void FdEvent::clearCoroutine() {
     m_coroutine = nullptr;
 }
 
+void FdEvent::registerPersistent() {
+    m_listen_events = READ | WRITE | EPOLLET | EPOLLRDHUP;
+    m_wait_events = 0;
+    m_is_persistent = true;
+    updateToReactor();
+}
+
+bool FdEvent::isPersistent() const {
+    return m_is_persistent;
+}
+
+void FdEvent::setWaitEvents(int events) {
+    m_wait_events = events;
+}
+
+int FdEvent::getWaitEvents() const {
+    return m_wait_events;
+}
+
 void FdEvent::updateToReactor() {
     epoll_event event;
     event.data.ptr = this;
@@ -143,6 +168,8 @@ void FdEvent::unregisterFromReactor() {
 
     m_reactor->delEvent(m_fd);
     m_listen_events = 0;
+    m_wait_events = 0;
+    m_is_persistent = false;
     m_read_callback = nullptr;
     m_write_callback = nullptr;
 }
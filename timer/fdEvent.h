@@ -46,7 +46,16 @@ public:
     Coroutine *getCoroutine();
     void clearCoroutine();
 
+    /* 以 EPOLLIN | EPOLLOUT | EPOLLET | EPOLLRDHUP 常驻注册, 之后等待 IO 不再需要 epoll_ctl */
+    void registerPersistent();
+    bool isPersistent() const;
+
+    /* 常驻注册时, 协程正在等待的事件 */
+    void setWaitEvents(int events);
+    int getWaitEvents() const;
+
     void updateToReactor();
+    /* 关闭 fd 之前调用; 在 reactor 的线程中同步清掉它缓存的事件, 其他线程中投递给 reactor */
     void unregisterFromReactor();
     void setReactor(Reactor *);
     Reactor *getReactor() const;
@@ -54,6 +63,8 @@ public:
 protected:
     int m_fd;
     int m_listen_events;
+    int m_wait_events;
+    bool m_is_persistent;
 
     std::function<void()> m_read_callback;
     std::function<void()> m_write_callback;
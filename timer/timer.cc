@@ -1,11 +1,14 @@
 #include <time.h>
 #include <string.h>
 #include <unistd.h>
-#include <sys/time.h>
 #include <sys/timerfd.h>
 
 #include "timer.h"
+#include "clock.h"
+#include "timerHeap.h"
+#include "timingWheel.h"
 #include "log.h"
+#include "reactor.h"
 #include "coroutineHook.h"
 
 extern read_fun_ptr_t g_sys_read_fun;
@@ -13,144 +16,385 @@ extern read_fun_ptr_t g_sys_read_fun;
 namespace util {
 
 int64_t getNowMs() {
-    timeval val;
-    ::gettimeofday(&val, nullptr);
-    int64_t re = val.tv_sec * 1000 + val.tv_usec / 1000;    // ms
-    return re;
+    return Clock::NowMs();
 }
 
-Timer::Timer(Reactor *reacor) : FdEvent(reacor) {
+Timer::Timer(Reactor *reacor, TimerMode mode /*= TimerFdMode*/, TimerEngine engine /*= HeapEngine*/)
+    : FdEvent(reacor),
+      m_mode(mode),
+      m_engine(engine),
+      m_queue(nullptr),
+      m_free_slot(-1),
+      m_active_count(0),
+      m_armed_time(-1) {
+
+    if(m_engine == WheelEngine) {
+        m_queue = new TimingWheel(m_slots);
+    } else {
+        m_queue = new TimerHeap(m_slots);
+    }
+
+    m_read_callback = std::bind(&Timer::onTimer, this);
+    if(m_mode == LoopDrivenMode) {
+        LOG_INFO << "timer is driven by reactor loop, no timer fd";
+        return ;
+    }
+
     m_fd = ::timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
     LOG_INFO << "timer fd = " << m_fd;
     if(m_fd == -1) {
         LOG_ERROR << "timerfd_create error";
     }
 
-    m_read_callback = std::bind(&Timer::onTimer, this);
     addListenEvents(READ);
 }
 
 Timer::~Timer() {
-    ::close(m_fd);
+    TimerCommand *command = nullptr;
+    while((command = m_commands.pop()) != nullptr) {
+        delete command;
+    }
+
+    delete m_queue;
+    if(m_fd != -1) {
+        ::close(m_fd);
+    }
 }
 
-void Timer::addTimerEvent(TimerEvent::ptr event, bool need_reset /*= true*/) {
+TimerHandle Timer::addTimerEvent(TimerEvent::ptr event, bool need_reset /*= true*/) {
     LOG_DEBUG << "addTimerEvent arrive_time = " << event->m_arrive_time;
-    RWMutex::WriteLock wlock(m_event_mutex);
-    bool is_reset = false;
-    if(m_pending_events.empty()) {
-        is_reset = true;
-    } else {
-        auto it = m_pending_events.begin();
-        if(event->m_arrive_time < it->first) {
-            is_reset = true;
-        }
+    if(!isOwnerThread()) {
+        TimerCommand *command = new TimerCommand(TimerCommand::AddEvent);
+        command->m_event = event;
+        submit(command);
+        return TimerHandle();
     }
 
-    m_pending_events.emplace(event->m_arrive_time, event);
-    wlock.unlock();
-    
-    if(is_reset && need_reset) {
+    TimerSlot *slot = findSlot(event->m_handle);
+    if(!slot || slot->m_event != event) {
+        event->m_handle = allocSlot(event, nullptr, event->m_slack);
+    }
+    /* 最近的到期时间提前了才需要重新设置 timerfd */
+    if(scheduleSlot(event->m_handle.m_slot, event->m_arrive_time) && need_reset) {
         LOG_DEBUG << "need reset timer";
         resetArriveTime();
     }
+    return event->m_handle;
 }
 
 void Timer::delTimerEvent(TimerEvent::ptr event) {
+    /* 先标记, 取消命令还没执行时到期也不会执行回调 */
     event->m_is_cancled = true;
 
-    RWMutex::WriteLock wlock(m_event_mutex);
-    auto begin = m_pending_events.lower_bound(event->m_arrive_time);
-    auto end = m_pending_events.upper_bound(event->m_arrive_time);
-    auto it = begin;
-    for(it = begin; it != end; it++) {
-        if(it->second == event) {
-            LOG_DEBUG << "find timer event, now delete it. src arrive time=" << event->m_arrive_time;
-            break;
-        }
+    if(!isOwnerThread()) {
+        TimerCommand *command = new TimerCommand(TimerCommand::DelEvent);
+        command->m_event = event;
+        submit(command);
+        return ;
+    }
+
+    TimerSlot *slot = findSlot(event->m_handle);
+    bool removed = slot && slot->m_event == event;
+    if(removed) {
+        freeSlot(event->m_handle.m_slot);
+    }
+    LOG_DEBUG << "del timer event " << (removed ? "succ" : "skip, not pending") << ", origin arrvite time=" << event->m_arrive_time;
+}
+
+TimerHandle Timer::addTimer(int64_t interval, std::function<void()> task, int64_t slack /*= 0*/) {
+    if(!isOwnerThread()) {
+        addTimerEvent(std::make_shared<TimerEvent>(interval, false, task, slack));
+        return TimerHandle();
+    }
+
+    TimerHandle handle = allocSlot(nullptr, task, slack);
+    if(scheduleSlot(handle.m_slot, getNowMs() + interval)) {
+        resetArriveTime();
     }
+    return handle;
+}
 
-    if(it != m_pending_events.end()) {
-        m_pending_events.erase(it);
+bool Timer::cancelTimer(const TimerHandle &handle) {
+    if(!isOwnerThread()) {
+        TimerCommand *command = new TimerCommand(TimerCommand::CancelHandle);
+        command->m_handle = handle;
+        submit(command);
+        return handle.isSet();
     }
-    wlock.unlock();
 
-    LOG_DEBUG << "del timer event succ, origin arrvite time=" << event->m_arrive_time;
+    TimerSlot *slot = findSlot(handle);
+    if(!slot) {
+        return false;
+    }
+
+    if(slot->m_event) {
+        slot->m_event->m_is_cancled = true;
+    }
+    freeSlot(handle.m_slot);
+    return true;
+}
+
+bool Timer::resetTimer(const TimerHandle &handle, int64_t interval) {
+    int64_t arrive_time = getNowMs() + interval;
+    if(!isOwnerThread()) {
+        TimerCommand *command = new TimerCommand(TimerCommand::ResetHandle);
+        command->m_handle = handle;
+        command->m_arrive_time = arrive_time;
+        submit(command);
+        return handle.isSet();
+    }
+    return resetSlot(handle, arrive_time);
 }
 
 void Timer::resetArriveTime() {
-    RWMutex::ReadLock rlock(m_event_mutex);
-    std::multimap<int64_t, TimerEvent::ptr> tmp = m_pending_events;
-    rlock.unlock();
+    /* 其他线程不碰 timerfd, 唤醒所属的 reactor, 它执行完提交的命令后会重新设置 */
+    if(!isOwnerThread()) {
+        m_reactor->wakeup();
+        return ;
+    }
+    /* loop 线程每轮阻塞之前都会重新计算超时 */
+    if(m_mode == LoopDrivenMode) {
+        return ;
+    }
 
-    if(tmp.size() == 0) {
+    int64_t arrive_time = m_queue->earliest();
+    if(arrive_time == -1) {
         LOG_DEBUG << "no timer event pending";
         return ;
     }
-
-    int64_t now = getNowMs();
-    auto it = tmp.rbegin();
-    if(it->first < now) {
-        LOG_DEBUG << "all timer events has already expire";
+    /* 最近的到期时间没变 (比如 slack 取整到了同一个时间点), 不需要再设置 */
+    if(arrive_time == m_armed_time) {
         return ;
     }
-
-    int64_t interval = it->first - now;
+    m_armed_time = arrive_time;
 
     itimerspec new_time;
     ::memset(&new_time, 0, sizeof(new_time));
 
-    timespec ts;
-    ::memset(&ts, 0, sizeof(ts));
-    ts.tv_sec = interval / 1000;
-    ts.tv_nsec = (interval % 1000) * 1000000;
-    new_time.it_value = ts;
+    /* 到期时间和 timerfd 都是 CLOCK_MONOTONIC, 直接设置绝对时间, 不受缓存的当前时间影响; 已经过去的会立即触发 */
+    new_time.it_value.tv_sec = arrive_time / 1000;
+    new_time.it_value.tv_nsec = (arrive_time % 1000) * 1000000;
 
-    int rt = timerfd_settime(m_fd, 0, &new_time, nullptr);
+    int rt = timerfd_settime(m_fd, TFD_TIMER_ABSTIME, &new_time, nullptr);
     if (rt != 0) {
-        LOG_ERROR << "timerfd_settime error, interval = " << interval;
+        LOG_ERROR << "timerfd_settime error, arrive time = " << arrive_time;
     }
 }
 
 void Timer::onTimer() {
     LOG_DEBUG << "Timer::onTimer is executed";
     char buf[8];
-    while(1) {
+    while(m_mode == TimerFdMode) {
         if((g_sys_read_fun(m_fd, buf, 8) == -1) && errno == EAGAIN) {
             break;
         }
     }
+    /* timerfd 触发之后就不再设置了 */
+    m_armed_time = -1;
 
-    int64_t now = getNowMs();
-    RWMutex::WriteLock wlock(m_event_mutex);
-    auto it = m_pending_events.begin();
-    std::vector<TimerEvent::ptr> tmp;
-    std::vector<std::pair<int64_t, std::function<void()>>> tmp_task;
-    for(it = m_pending_events.begin(); it != m_pending_events.end(); it++) {
-        if(it->first <= now && !it->second->m_is_cancled) {
-            tmp.push_back(it->second);
-            tmp_task.push_back(std::make_pair(it->first, it->second->m_task));
-        } else {
-            break;
+    applyCommands();
+
+    struct Expired {
+        TimerHandle m_handle;
+        bool m_is_repeated;
+    };
+
+    std::vector<uint32_t> indexes;
+    std::vector<Expired> expired;
+
+    m_queue->popExpired(getNowMs(), indexes);
+    for(size_t i = 0; i < indexes.size(); i++) {
+        TimerSlot &slot = m_slots[indexes[i]];
+        /* 直接调用 TimerEvent::cancle() 的事件到期后丢弃 */
+        if(slot.m_event && slot.m_event->m_is_cancled) {
+            freeSlot(indexes[i]);
+            continue;
         }
-    }
 
-    m_pending_events.erase(m_pending_events.begin(), it);
-    wlock.unlock();
+        Expired item;
+        item.m_handle = TimerHandle(indexes[i], slot.m_generation);
+        item.m_is_repeated = slot.m_event && slot.m_event->m_is_repeated;
+        expired.push_back(item);
+    }
 
-    for(auto etmp : tmp) {
-        if(etmp->m_is_repeated) {
-            etmp->resetTime();
-            addTimerEvent(etmp, false);
+    /* 重复的事件在执行回调之前放回去 */
+    for(size_t i = 0; i < expired.size(); i++) {
+        if(expired[i].m_is_repeated) {
+            TimerEvent::ptr event = m_slots[expired[i].m_handle.m_slot].m_event;
+            /* 不用 resetTime(), 它会清掉其他线程刚设置的取消标记 */
+            event->m_arrive_time = getNowMs() + event->m_interval;
+            scheduleSlot(expired[i].m_handle.m_slot, event->m_arrive_time);
+            /* 放回去之后再确认一次, 期间被其他线程取消的直接释放, 回调不会执行 */
+            if(event->m_is_cancled) {
+                freeSlot(expired[i].m_handle.m_slot);
+            }
         }
     }
 
     resetArriveTime();
 
-    for(auto ttmp : tmp_task) {
-        ttmp.second();
+    for(size_t i = 0; i < expired.size(); i++) {
+        /* 可能被同一批中先执行的回调取消或重新安排, 执行之前再确认一次 */
+        TimerSlot *slot = findSlot(expired[i].m_handle);
+        if(!slot) {
+            continue;
+        }
+
+        TimerEvent::ptr event = slot->m_event;
+        std::function<void()> task;
+        if(!expired[i].m_is_repeated) {
+            if(slot->m_queued) {
+                continue;
+            }
+            task.swap(slot->m_task);
+            freeSlot(expired[i].m_handle.m_slot);
+        }
+
+        if(event) {
+            if(!event->m_is_cancled && event->m_task) {
+                event->m_task();
+            }
+        } else if(task) {
+            task();
+        }
     }
     LOG_DEBUG << "Timer::onTimer is end";
 }
 
+void Timer::applyCommands() {
+    if(m_commands.empty()) {
+        return ;
+    }
+
+    /* 只处理进来时已经在队列中的命令, 其他线程一直提交时也不会卡在这里 */
+    int64_t budget = m_commands.size();
+    bool is_reset = false;
+    TimerCommand *command = nullptr;
+    while(budget-- > 0 && (command = m_commands.pop()) != nullptr) {
+        switch(command->m_type) {
+        case TimerCommand::AddEvent:
+            addTimerEvent(command->m_event, false);
+            is_reset = true;
+            break;
+        case TimerCommand::DelEvent:
+            delTimerEvent(command->m_event);
+            break;
+        case TimerCommand::CancelHandle:
+            cancelTimer(command->m_handle);
+            break;
+        case TimerCommand::ResetHandle:
+            resetSlot(command->m_handle, command->m_arrive_time);
+            break;
+        }
+        delete command;
+    }
+
+    if(is_reset) {
+        resetArriveTime();
+    }
+    /* 剩下的留给下一轮 loop, 不要阻塞在 epoll_wait 上 */
+    if(m_reactor && !m_commands.empty()) {
+        m_reactor->wakeup();
+    }
+}
+
+int64_t Timer::getNextTimeoutNs() {
+    applyCommands();
+
+    int64_t arrive_time = m_queue->earliest();
+    if(arrive_time == -1) {
+        return -1;
+    }
+
+    int64_t timeout_ns = arrive_time * 1000000 - Clock::NowNs();
+    return timeout_ns > 0 ? timeout_ns : 0;
+}
+
+size_t Timer::getPendingCount() {
+    return m_active_count;
+}
+
+bool Timer::isOwnerThread() const {
+    /* 不属于任何 reactor 的 Timer (比如压测中单独创建的) 只能在一个线程中使用 */
+    return m_reactor == nullptr || Reactor::GetCurrentReactor() == m_reactor;
+}
+
+void Timer::submit(TimerCommand *command) {
+    m_commands.push(command);
+    m_reactor->wakeup();
+}
+
+TimerHandle Timer::allocSlot(TimerEvent::ptr event, std::function<void()> task, int64_t slack) {
+    uint32_t index = 0;
+    if(m_free_slot != -1) {
+        index = m_free_slot;
+        m_free_slot = m_slots[index].m_next_free;
+    } else {
+        index = m_slots.size();
+        m_slots.push_back(TimerSlot());
+    }
+
+    TimerSlot &slot = m_slots[index];
+    slot.m_event = event;
+    slot.m_task = task;
+    slot.m_slack = slack;
+    slot.m_in_use = true;
+    m_active_count++;
+    return TimerHandle(index, slot.m_generation);
+}
+
+void Timer::freeSlot(uint32_t index) {
+    TimerSlot &slot = m_slots[index];
+    if(slot.m_queued) {
+        m_queue->unschedule(index);
+    }
+
+    slot.m_event.reset();
+    slot.m_task = nullptr;
+    slot.m_in_use = false;
+    /* 0 留给未设置的句柄 */
+    if(++slot.m_generation == 0) {
+        slot.m_generation = 1;
+    }
+    slot.m_next_free = m_free_slot;
+    m_free_slot = index;
+    m_active_count--;
+}
+
+bool Timer::scheduleSlot(uint32_t index, int64_t arrive_time) {
+    int64_t slack = m_slots[index].m_slack;
+    if(slack > 1) {
+        /* 取整的单位不超过 slack, 推迟的时间也就不超过 slack */
+        int64_t unit = 1;
+        while(unit * 2 <= slack) {
+            unit *= 2;
+        }
+        arrive_time = (arrive_time + unit - 1) / unit * unit;
+    }
+    return m_queue->schedule(index, arrive_time);
+}
+
+bool Timer::resetSlot(const TimerHandle &handle, int64_t arrive_time) {
+    TimerSlot *slot = findSlot(handle);
+    if(!slot) {
+        return false;
+    }
+
+    if(slot->m_event) {
+        slot->m_event->m_arrive_time = arrive_time;
+    }
+    if(scheduleSlot(handle.m_slot, arrive_time)) {
+        resetArriveTime();
+    }
+    return true;
+}
+
+TimerSlot *Timer::findSlot(const TimerHandle &handle) {
+    if(handle.m_slot >= m_slots.size()) {
+        return nullptr;
+    }
+    TimerSlot &slot = m_slots[handle.m_slot];
+    return (slot.m_in_use && slot.m_generation == handle.m_generation) ? &slot : nullptr;
+}
+
 }   // namespace util
\ No newline at end of file
@@ -1,26 +1,54 @@
 #ifndef _TIMER_H
 #define _TIMER_H
 
-#include <map>
+#include <atomic>
+#include <vector>
+#include <stdint.h>
 #include <functional>
 
 #include "log.h"
 #include "fdEvent.h"
-#include "mutex.h"
+#include "mpscQueue.h"
+#include "timerQueue.h"
 
 namespace util {
 
 /* 避免头文件相互包含 */
 class Reactor;
 
+/* 单调时钟的毫秒数, 在 reactor 线程中是这一轮 loop 缓存的时间, 见 Clock */
 int64_t getNowMs();
 
+enum TimerMode {
+    TimerFdMode = 1,        // 到期时间写入 timerfd, timerfd 可读时执行到期的事件
+    LoopDrivenMode = 2      // 不使用 timerfd, reactor 按最近的到期时间计算 epoll_wait 的超时, 醒来后直接执行
+};
+
+enum TimerEngine {
+    HeapEngine = 1,         // 4 叉最小堆, 精确到毫秒, 不限跨度
+    WheelEngine = 2         // 分层时间轮 (ms / s / min), 增删 O(1), 适合大量短超时
+};
+
+/* Timer 槽位表中的 (下标, 代数), 槽位回收时代数加一, 旧的句柄自然失效 */
+struct TimerHandle {
+    TimerHandle() : m_slot(0), m_generation(0) {}
+    TimerHandle(uint32_t slot, uint32_t generation) : m_slot(slot), m_generation(generation) {}
+
+    /* 只说明曾经加入过定时器, 是否已经到期或取消要问 Timer */
+    bool isSet() const { return m_generation != 0; }
+
+    uint32_t m_slot;
+    uint32_t m_generation;
+};
+
 class TimerEvent {
 public:
     typedef std::shared_ptr<TimerEvent> ptr;
 
-    TimerEvent(int64_t interval, bool is_repeated, std::function<void()> task)
+    /* slack: 允许推迟执行的毫秒数, 见 Timer::addTimerEvent */
+    TimerEvent(int64_t interval, bool is_repeated, std::function<void()> task, int64_t slack = 0)
         : m_interval(interval),
+          m_slack(slack),
           m_is_repeated(is_repeated),
           m_is_cancled(false),
           m_task(task) {
@@ -47,30 +75,99 @@ public:
 
     int64_t m_arrive_time;  // ms
     int64_t m_interval;     // ms
+    int64_t m_slack;        // ms
 
     bool m_is_repeated;
-    bool m_is_cancled;
+    std::atomic<bool> m_is_cancled;     // 可能在其他线程取消
+
+    TimerHandle m_handle;   // addTimerEvent 时设置, delTimerEvent 用它直接找到槽位
 
     std::function<void()> m_task;
 };
 
 
+/*
+ * 定时器只在所属 reactor 的线程中修改, 不加锁
+ * 其他线程的增删改封装成命令放进无锁的 MPSC 队列并唤醒 reactor, 由它在下一次处理定时器之前执行
+ */
 class Timer : public util::FdEvent {
 public:
     typedef std::shared_ptr<Timer> ptr;
 
-    Timer(Reactor *reacor);
+    Timer(Reactor *reacor, TimerMode mode = TimerFdMode, TimerEngine engine = HeapEngine);
     ~Timer();
 
-    void addTimerEvent(TimerEvent::ptr event, bool need_reset = true);
+    /*
+     * 同一个事件还在等待时再次加入, 按它新的 m_arrive_time 重新安排, 句柄不变
+     * m_slack 不为 0 时, 到期时间向上取整到不超过 slack 的最大的 2 的幂毫秒,
+     * 时间相近的定时器落在同一个时间点, 一次唤醒一起执行, 也不用为每个定时器重新设置 timerfd
+     * 在其他线程调用时返回空句柄, 句柄之后会设置到 event->m_handle, 用 delTimerEvent 取消
+     */
+    TimerHandle addTimerEvent(TimerEvent::ptr event, bool need_reset = true);
+    /* 在任何线程调用之后, 回调都不会再执行 */
     void delTimerEvent(TimerEvent::ptr event);
 
+    /* 单次定时器, 不创建 TimerEvent; slack 同上; 在其他线程调用时会创建 TimerEvent, 返回空句柄 */
+    TimerHandle addTimer(int64_t interval, std::function<void()> task, int64_t slack = 0);
+    /*
+     * O(1), 已经到期执行过或者已经取消的返回 false; 取消之后回调一定不会再执行
+     * 在其他线程调用时只是提交, 返回值只说明句柄是否设置过, 提交之前已经开始执行的回调不受影响
+     */
+    bool cancelTimer(const TimerHandle &handle);
+    /* 改为从现在起 interval 毫秒后到期, 推迟是 O(1) 的; 失效的句柄返回 false; 其他线程调用同上 */
+    bool resetTimer(const TimerHandle &handle, int64_t interval);
+
     void onTimer();
     void resetArriveTime();
 
+    /* 执行其他线程提交的命令, 只在所属线程调用, reactor 每轮都会调用 */
+    void applyCommands();
+
+    TimerMode getMode() const { return m_mode; }
+    TimerEngine getEngine() const { return m_engine; }
+
+    /* 距离最近一个事件到期的纳秒数, 已经到期返回 0, 没有事件返回 -1; 只在所属线程调用 */
+    int64_t getNextTimeoutNs();
+
+    /* 只在所属线程调用 */
+    size_t getPendingCount();
+
 // private:
-    std::multimap<int64_t, TimerEvent::ptr> m_pending_events;
-    RWMutex m_event_mutex;
+    struct TimerCommand : public MpscNode {
+        enum Type {
+            AddEvent = 1,
+            DelEvent = 2,
+            CancelHandle = 3,
+            ResetHandle = 4
+        };
+
+        explicit TimerCommand(Type type) : m_type(type), m_arrive_time(0) {}
+
+        Type m_type;
+        TimerEvent::ptr m_event;
+        TimerHandle m_handle;
+        int64_t m_arrive_time;
+    };
+
+    bool isOwnerThread() const;
+    void submit(TimerCommand *command);
+
+    /* 下面的函数只在所属线程调用 */
+    TimerHandle allocSlot(TimerEvent::ptr event, std::function<void()> task, int64_t slack);
+    void freeSlot(uint32_t index);
+    /* 按槽位的 slack 取整后交给引擎, 返回 true 表示最近的到期时间可能提前了 */
+    bool scheduleSlot(uint32_t index, int64_t arrive_time);
+    bool resetSlot(const TimerHandle &handle, int64_t arrive_time);
+    TimerSlot *findSlot(const TimerHandle &handle);
+
+    TimerMode m_mode;
+    TimerEngine m_engine;
+    TimerSlots m_slots;
+    TimerQueue *m_queue;
+    int m_free_slot;
+    size_t m_active_count;
+    int64_t m_armed_time;       // timerfd 当前设置的到期时间, -1 表示没有设置
+    MpscQueue<TimerCommand> m_commands;
 };
 
 }   // namespace util
@@ -0,0 +1,167 @@
+#include "timerHeap.h"
+
+#include <algorithm>
+
+namespace util {
+
+TimerHeap::TimerHeap(TimerSlots &slots) : TimerQueue(slots), m_stale_count(0) {}
+
+bool TimerHeap::schedule(uint32_t index, int64_t arrive_time) {
+    TimerSlot &slot = m_slots[index];
+    if(slot.m_queued && arrive_time >= slot.m_arrive_time) {
+        slot.m_arrive_time = arrive_time;
+        return false;
+    }
+
+    /* 先改版本号再计数, staleAdded() 中压缩时旧的条目已经是失效的 */
+    bool has_stale = slot.m_queued;
+    slot.m_arrive_time = arrive_time;
+    slot.m_version++;
+    slot.m_queued = true;
+    if(has_stale) {
+        staleAdded();
+    }
+
+    Entry entry;
+    entry.m_arrive_time = arrive_time;
+    entry.m_slot = index;
+    entry.m_version = slot.m_version;
+    return push(entry);
+}
+
+void TimerHeap::unschedule(uint32_t index) {
+    TimerSlot &slot = m_slots[index];
+    slot.m_version++;
+    slot.m_queued = false;
+    staleAdded();
+}
+
+int64_t TimerHeap::earliest() {
+    while(!m_entries.empty()) {
+        const Entry &top = m_entries[0];
+        const TimerSlot &slot = m_slots[top.m_slot];
+        if(isStale(top)) {
+            pop();
+            m_stale_count--;
+            continue;
+        }
+        if(slot.m_arrive_time > top.m_arrive_time) {
+            Entry entry = pop();
+            entry.m_arrive_time = slot.m_arrive_time;
+            push(entry);
+            continue;
+        }
+        return top.m_arrive_time;
+    }
+    return -1;
+}
+
+void TimerHeap::popExpired(int64_t now, std::vector<uint32_t> &expired) {
+    while(!m_entries.empty() && m_entries[0].m_arrive_time <= now) {
+        Entry entry = pop();
+        TimerSlot &slot = m_slots[entry.m_slot];
+        if(isStale(entry)) {
+            m_stale_count--;
+            continue;
+        }
+        if(slot.m_arrive_time > entry.m_arrive_time) {
+            /* 被推迟过, 按真正的到期时间放回去 */
+            entry.m_arrive_time = slot.m_arrive_time;
+            push(entry);
+            continue;
+        }
+
+        slot.m_queued = false;
+        expired.push_back(entry.m_slot);
+    }
+}
+
+bool TimerHeap::isStale(const Entry &entry) const {
+    const TimerSlot &slot = m_slots[entry.m_slot];
+    return !slot.m_in_use || !slot.m_queued || slot.m_version != entry.m_version;
+}
+
+void TimerHeap::staleAdded() {
+    m_stale_count++;
+    if(m_stale_count < 1024 || m_stale_count < m_entries.size() / 2) {
+        return ;
+    }
+
+    size_t kept = 0;
+    for(size_t i = 0; i < m_entries.size(); i++) {
+        if(!isStale(m_entries[i])) {
+            m_entries[kept++] = m_entries[i];
+        }
+    }
+    m_entries.resize(kept);
+    heapify();
+    m_stale_count = 0;
+}
+
+bool TimerHeap::push(const Entry &entry) {
+    m_entries.push_back(entry);
+    siftUp(m_entries.size() - 1);
+    return m_entries[0].m_slot == entry.m_slot && m_entries[0].m_version == entry.m_version;
+}
+
+TimerHeap::Entry TimerHeap::pop() {
+    Entry entry = m_entries[0];
+    m_entries[0] = m_entries.back();
+    m_entries.pop_back();
+    if(!m_entries.empty()) {
+        siftDown(0);
+    }
+    return entry;
+}
+
+void TimerHeap::siftUp(size_t index) {
+    /* 先把节点拿出来, 沿途的父节点依次下移, 最后只写一次 */
+    Entry entry = m_entries[index];
+    while(index > 0) {
+        size_t parent = (index - 1) / ARITY;
+        if(m_entries[parent].m_arrive_time <= entry.m_arrive_time) {
+            break;
+        }
+        m_entries[index] = m_entries[parent];
+        index = parent;
+    }
+    m_entries[index] = entry;
+}
+
+void TimerHeap::siftDown(size_t index) {
+    size_t size = m_entries.size();
+    Entry entry = m_entries[index];
+
+    while(true) {
+        size_t first = index * ARITY + 1;
+        if(first >= size) {
+            break;
+        }
+
+        size_t last = std::min(first + ARITY, size);
+        size_t min_child = first;
+        for(size_t i = first + 1; i < last; i++) {
+            if(m_entries[i].m_arrive_time < m_entries[min_child].m_arrive_time) {
+                min_child = i;
+            }
+        }
+
+        if(entry.m_arrive_time <= m_entries[min_child].m_arrive_time) {
+            break;
+        }
+        m_entries[index] = m_entries[min_child];
+        index = min_child;
+    }
+    m_entries[index] = entry;
+}
+
+void TimerHeap::heapify() {
+    if(m_entries.size() < 2) {
+        return ;
+    }
+    for(size_t i = (m_entries.size() - 2) / ARITY + 1; i > 0; i--) {
+        siftDown(i - 1);
+    }
+}
+
+}   // namespace util
@@ -0,0 +1,48 @@
+#ifndef _TIMERHEAP_H
+#define _TIMERHEAP_H
+
+#include "timerQueue.h"
+
+namespace util {
+
+/*
+ * 按到期时间排序的 4 叉最小堆, 元素只有 (到期时间, 槽位, 版本号) 三个整数, 移动时不涉及引用计数
+ * 取消或提前时旧的元素留在堆里, 版本号对不上, 到堆顶时再丢弃 (惰性删除), 失效的超过一半时整理一次
+ * 推迟不动堆, 旧的元素到堆顶时再按槽位上真正的到期时间放回去
+ * schedule O(log n) (推迟 O(1)), unschedule O(1), earliest 均摊 O(1)
+ */
+class TimerHeap : public TimerQueue {
+public:
+    explicit TimerHeap(TimerSlots &slots);
+
+    bool schedule(uint32_t index, int64_t arrive_time);
+    void unschedule(uint32_t index);
+    int64_t earliest();
+    void popExpired(int64_t now, std::vector<uint32_t> &expired);
+
+private:
+    static const size_t ARITY = 4;
+
+    struct Entry {
+        int64_t m_arrive_time;  // ms
+        uint32_t m_slot;
+        uint32_t m_version;
+    };
+
+    bool isStale(const Entry &entry) const;
+    void staleAdded();
+
+    /* 返回 true 表示它成为了堆顶 */
+    bool push(const Entry &entry);
+    Entry pop();
+    void siftUp(size_t index);
+    void siftDown(size_t index);
+    void heapify();
+
+    std::vector<Entry> m_entries;
+    size_t m_stale_count;
+};
+
+}   // namespace util
+
+#endif
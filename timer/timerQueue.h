@@ -0,0 +1,73 @@
+#ifndef _TIMERQUEUE_H
+#define _TIMERQUEUE_H
+
+#include <vector>
+#include <memory>
+#include <functional>
+#include <stddef.h>
+#include <stdint.h>
+
+namespace util {
+
+/* 避免头文件相互包含 */
+class TimerEvent;
+
+/* Timer 槽位表中的一个定时器, 各个引擎直接在槽位上记录自己需要的信息 */
+struct TimerSlot {
+    TimerSlot()
+        : m_arrive_time(0),
+          m_slack(0),
+          m_generation(1),
+          m_next_free(-1),
+          m_in_use(false),
+          m_queued(false),
+          m_version(0),
+          m_prev(-1),
+          m_next(-1),
+          m_bucket(-1) {}
+
+    std::shared_ptr<TimerEvent> m_event;    // addTimer 加入的为空, 直接用 m_task
+    std::function<void()> m_task;
+    int64_t m_arrive_time;                  // ms, 已经按 m_slack 取整
+    int64_t m_slack;                        // ms
+    uint32_t m_generation;
+    int m_next_free;
+    bool m_in_use;
+    bool m_queued;                          // 在引擎中等待到期
+
+    /* TimerHeap: 堆里版本号不同的元素都已失效 */
+    uint32_t m_version;
+
+    /* TimingWheel: 所在的桶和桶内的双向链表 */
+    int m_prev;
+    int m_next;
+    int m_bucket;
+};
+
+typedef std::vector<TimerSlot> TimerSlots;
+
+/*
+ * 定时器引擎, 按到期时间组织 Timer 槽位表中的定时器, 只处理槽位下标
+ * 不加锁, 由 Timer 负责同步
+ */
+class TimerQueue {
+public:
+    explicit TimerQueue(TimerSlots &slots) : m_slots(slots) {}
+    virtual ~TimerQueue() {}
+
+    /* 安排槽位在 arrive_time 到期, 已经在等待时调整位置; 返回 true 表示最近的到期时间可能提前了 */
+    virtual bool schedule(uint32_t index, int64_t arrive_time) = 0;
+    /* 只对正在等待的槽位调用 */
+    virtual void unschedule(uint32_t index) = 0;
+    /* 最近的到期时间, 允许比实际的早 (到时 popExpired 可能什么也取不到), 没有返回 -1 */
+    virtual int64_t earliest() = 0;
+    /* 取出所有到期时间 <= now 的槽位, 按到期的先后追加到 expired */
+    virtual void popExpired(int64_t now, std::vector<uint32_t> &expired) = 0;
+
+protected:
+    TimerSlots &m_slots;
+};
+
+}   // namespace util
+
+#endif
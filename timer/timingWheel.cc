@@ -0,0 +1,215 @@
+#include "timer.h"
+#include "timingWheel.h"
+
+#include <algorithm>
+
+namespace util {
+
+TimingWheel::TimingWheel(TimerSlots &slots)
+    : TimerQueue(slots),
+      m_heads(OVERFLOW_BUCKET + 1, -1),
+      m_tails(OVERFLOW_BUCKET + 1, -1),
+      m_size(0),
+      m_current(getNowMs()),
+      m_earliest(-1) {
+
+    for(int i = 0; i < LevelCount; i++) {
+        m_counts[i] = 0;
+    }
+}
+
+bool TimingWheel::schedule(uint32_t index, int64_t arrive_time) {
+    TimerSlot &slot = m_slots[index];
+    if(slot.m_queued) {
+        unlink(index);
+    }
+    slot.m_arrive_time = arrive_time;
+    slot.m_queued = true;
+
+    /* m_current 这一毫秒已经处理过了 */
+    int64_t fire_time = place(index, m_current + 1);
+    if(m_earliest == -1 || fire_time >= m_earliest) {
+        return m_earliest == -1;
+    }
+    m_earliest = fire_time;
+    return true;
+}
+
+void TimingWheel::unschedule(uint32_t index) {
+    /* 缓存的 earliest 偏早也没关系 */
+    unlink(index);
+    m_slots[index].m_queued = false;
+}
+
+int64_t TimingWheel::earliest() {
+    if(m_size == 0) {
+        return -1;
+    }
+    if(m_earliest != -1) {
+        return m_earliest;
+    }
+
+    /* 低层有定时器时结果是准确的, 否则返回下一次级联的时间 */
+    if(m_counts[MsLevel] > 0) {
+        int64_t end = (m_current / MS_BUCKETS + 1) * MS_BUCKETS;
+        for(int64_t t = m_current + 1; t < end; t++) {
+            if(m_heads[t % MS_BUCKETS] != -1) {
+                m_earliest = t;
+                return m_earliest;
+            }
+        }
+    }
+    if(m_counts[SecondLevel] > 0) {
+        int64_t second = m_current / 1000;
+        int64_t end = (second / SECOND_BUCKETS + 1) * SECOND_BUCKETS;
+        for(int64_t s = second + 1; s < end; s++) {
+            if(m_heads[SECOND_BASE + s % SECOND_BUCKETS] != -1) {
+                m_earliest = s * 1000;
+                return m_earliest;
+            }
+        }
+    }
+    if(m_counts[MinuteLevel] > 0) {
+        int64_t minute = m_current / 60000;
+        int64_t end = (minute / MINUTE_BUCKETS + 1) * MINUTE_BUCKETS;
+        for(int64_t m = minute + 1; m < end; m++) {
+            if(m_heads[MINUTE_BASE + m % MINUTE_BUCKETS] != -1) {
+                m_earliest = m * 60000;
+                return m_earliest;
+            }
+        }
+    }
+    m_earliest = (m_current / 3600000 + 1) * 3600000;
+    return m_earliest;
+}
+
+void TimingWheel::popExpired(int64_t now, std::vector<uint32_t> &expired) {
+    m_earliest = -1;
+    while(m_current < now) {
+        if(m_size == 0) {
+            m_current = now;
+            break;
+        }
+
+        /* 低层是空的, 直接跳到下一次级联之前 */
+        if(m_counts[MsLevel] == 0) {
+            int64_t unit = 3600000;
+            if(m_counts[SecondLevel] > 0) {
+                unit = 1000;
+            } else if(m_counts[MinuteLevel] > 0) {
+                unit = 60000;
+            }
+            int64_t skip_to = (m_current / unit + 1) * unit - 1;
+            if(skip_to >= now) {
+                m_current = now;
+                break;
+            }
+            m_current = std::max(m_current, skip_to);
+        }
+
+        int64_t current = ++m_current;
+        if(current % 1000 == 0) {
+            if(current % 60000 == 0) {
+                if(current % 3600000 == 0) {
+                    cascade(OVERFLOW_BUCKET);
+                }
+                cascade(MINUTE_BASE + (current / 60000) % MINUTE_BUCKETS);
+            }
+            cascade(SECOND_BASE + (current / 1000) % SECOND_BUCKETS);
+        }
+
+        int bucket = current % MS_BUCKETS;
+        while(m_heads[bucket] != -1) {
+            int index = m_heads[bucket];
+            unlink(index);
+            m_slots[index].m_queued = false;
+            expired.push_back(index);
+        }
+    }
+}
+
+TimingWheel::Level TimingWheel::levelOf(int bucket) {
+    if(bucket < SECOND_BASE) {
+        return MsLevel;
+    } else if(bucket < MINUTE_BASE) {
+        return SecondLevel;
+    } else if(bucket < OVERFLOW_BUCKET) {
+        return MinuteLevel;
+    }
+    return OverflowLevel;
+}
+
+int64_t TimingWheel::place(uint32_t index, int64_t floor) {
+    int64_t t = std::max(m_slots[index].m_arrive_time, floor);
+
+    if(t / 1000 == m_current / 1000) {
+        link(index, t % MS_BUCKETS);
+        return t;
+    } else if(t / 60000 == m_current / 60000) {
+        link(index, SECOND_BASE + (t / 1000) % SECOND_BUCKETS);
+        return t / 1000 * 1000;
+    } else if(t / 3600000 == m_current / 3600000) {
+        link(index, MINUTE_BASE + (t / 60000) % MINUTE_BUCKETS);
+        return t / 60000 * 60000;
+    }
+    link(index, OVERFLOW_BUCKET);
+    return t / 3600000 * 3600000;
+}
+
+void TimingWheel::link(uint32_t index, int bucket) {
+    /* 加在链表尾部, 同一毫秒到期的按加入的先后执行 */
+    TimerSlot &slot = m_slots[index];
+    int tail = m_tails[bucket];
+
+    slot.m_bucket = bucket;
+    slot.m_prev = tail;
+    slot.m_next = -1;
+    if(tail != -1) {
+        m_slots[tail].m_next = index;
+    } else {
+        m_heads[bucket] = index;
+    }
+    m_tails[bucket] = index;
+
+    m_counts[levelOf(bucket)]++;
+    m_size++;
+}
+
+void TimingWheel::unlink(uint32_t index) {
+    TimerSlot &slot = m_slots[index];
+    if(slot.m_prev != -1) {
+        m_slots[slot.m_prev].m_next = slot.m_next;
+    } else {
+        m_heads[slot.m_bucket] = slot.m_next;
+    }
+    if(slot.m_next != -1) {
+        m_slots[slot.m_next].m_prev = slot.m_prev;
+    } else {
+        m_tails[slot.m_bucket] = slot.m_prev;
+    }
+
+    m_counts[levelOf(slot.m_bucket)]--;
+    m_size--;
+    slot.m_prev = -1;
+    slot.m_next = -1;
+    slot.m_bucket = -1;
+}
+
+void TimingWheel::cascade(int bucket) {
+    /* 先把整条链表摘下来, 溢出链表里的可能又放回同一个桶 */
+    int index = m_heads[bucket];
+    Level level = levelOf(bucket);
+    m_heads[bucket] = -1;
+    m_tails[bucket] = -1;
+
+    while(index != -1) {
+        int next = m_slots[index].m_next;
+        m_counts[level]--;
+        m_size--;
+        /* 级联发生在处理 m_current 这一毫秒的桶之前 */
+        place(index, m_current);
+        index = next;
+    }
+}
+
+}   // namespace util
@@ -0,0 +1,61 @@
+#ifndef _TIMINGWHEEL_H
+#define _TIMINGWHEEL_H
+
+#include "timerQueue.h"
+
+namespace util {
+
+/*
+ * 分层时间轮: 1000 个 1ms 的桶, 60 个 1s 的桶, 60 个 1min 的桶, 一小时以外的放在溢出链表
+ * 定时器按到期时间的各位 (毫秒 / 秒 / 分) 放进对应的桶, 桶是串在槽位上的侵入式双向链表
+ * schedule / unschedule O(1); 高层的桶等到走到它的时候才整体下放到低一层 (惰性级联)
+ * 同一毫秒的桶一次全部取出; 没有定时器的层直接跳过, 空闲很久后 popExpired 不会逐毫秒空转
+ * 跨度和精度都是固定的, 适合大量短超时且多数会被取消的场景
+ */
+class TimingWheel : public TimerQueue {
+public:
+    explicit TimingWheel(TimerSlots &slots);
+
+    bool schedule(uint32_t index, int64_t arrive_time);
+    void unschedule(uint32_t index);
+    int64_t earliest();
+    void popExpired(int64_t now, std::vector<uint32_t> &expired);
+
+private:
+    enum Level {
+        MsLevel = 0,
+        SecondLevel = 1,
+        MinuteLevel = 2,
+        OverflowLevel = 3,
+        LevelCount = 4
+    };
+
+    static const int MS_BUCKETS = 1000;
+    static const int SECOND_BUCKETS = 60;
+    static const int MINUTE_BUCKETS = 60;
+
+    static const int SECOND_BASE = MS_BUCKETS;
+    static const int MINUTE_BASE = SECOND_BASE + SECOND_BUCKETS;
+    static const int OVERFLOW_BUCKET = MINUTE_BASE + MINUTE_BUCKETS;
+
+    static Level levelOf(int bucket);
+
+    /* 按 m_current 选择桶, 早于 floor 的按 floor 放; 返回定时器实际会在哪一毫秒被处理 */
+    int64_t place(uint32_t index, int64_t floor);
+    void link(uint32_t index, int bucket);
+    void unlink(uint32_t index);
+    /* 把一个高层的桶整体重新放置 */
+    void cascade(int bucket);
+
+    /* 每个桶链表头尾的槽位下标, -1 表示空 */
+    std::vector<int> m_heads;
+    std::vector<int> m_tails;
+    size_t m_counts[LevelCount];
+    size_t m_size;
+    int64_t m_current;              // 已经处理到的毫秒
+    int64_t m_earliest;             // earliest() 的缓存, -1 表示需要重新计算
+};
+
+}   // namespace util
+
+#endif